@@ -0,0 +1,267 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "assetcache.hpp"
+
+#include "cachefile.hpp"
+#include "wadfile.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+
+
+/* bump this whenever the layout of anything in a .wac changes
+ * (or the way anything in it is decoded) */
+static uint32_t const WAC_VERSION = 4;
+static char const WAC_MAGIC[4] = {'W', 'A', 'C', '\0'};
+
+/* lumps whose contents decide what the textures look like
+ * (patches, flats and sprites are covered by the directory hash, plus
+ *  the size and modification time of the files they're in, so editing
+ *  one in place still misses the cache) */
+static char const *const DEFINITION_LUMPS[] = {
+    "PLAYPAL", "COLORMAP", "PNAMES", "TEXTURE1", "TEXTURE2"
+};
+
+
+
+uint64_t assetkey(WAD &wad)
+{
+    uint64_t hash = FNV1A_BASIS;
+    hash = fnv1a(hash, &WAC_VERSION, sizeof(WAC_VERSION));
+
+    for (auto &source : wad.sources)
+    {
+        hash = fnv1a(hash, source.c_str(), source.size() + 1);
+    }
+    std::vector<WADFile const *> files{};
+    for (auto &lump : wad.directory)
+    {
+        auto file = lump.file.get();
+        if (   file != nullptr
+            && std::find(files.begin(), files.end(), file) == files.end())
+        {
+            files.push_back(file);
+
+            auto const size = file->size();
+            auto const mtime = file->mtime();
+            hash = fnv1a(hash, &size, sizeof(size));
+            hash = fnv1a(hash, &mtime, sizeof(mtime));
+        }
+
+        hash = fnv1a(hash, lump.name, strnlen(lump.name, 8));
+        hash = fnv1a(hash, &lump.size, sizeof(lump.size));
+        hash = fnv1a(hash, &lump.filepos, sizeof(lump.filepos));
+        hash = fnv1a(hash, &lump.source, sizeof(lump.source));
+    }
+
+    for (auto &name : DEFINITION_LUMPS)
+    {
+        try
+        {
+            auto lump = wad.directory[wad.lastidx(name)];
+            hash = fnv1a(hash, name, strlen(name));
+            hash = fnv1a(hash, lump.bytes(), lump.size);
+        }
+        catch (std::out_of_range &e)
+        {
+        }
+    }
+    return hash;
+}
+
+std::string assetcachepath(uint64_t key)
+{
+    return cachepath(key, "wac");
+}
+
+/* read how many entries follow, each at least 'least' bytes long
+ * (checked against what's left, so a corrupt count throws
+ *  std::out_of_range before anything's reserved for it) */
+static uint32_t _readcount(LumpCursor &cursor, size_t least)
+{
+    auto count = readvalue<uint32_t>(cursor);
+    if (count * least > cursor.remaining())
+    {
+        throw std::out_of_range{"WAC: count runs past the end"};
+    }
+    return count;
+}
+
+
+bool loadassetcache(uint64_t key, WAD &wad)
+{
+    auto file = mapcache(assetcachepath(key));
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    decltype(wad.palettes) palettes{};
+    decltype(wad.colormaps) colormaps{};
+    decltype(wad.textures) textures{};
+    decltype(wad.flats) flats{};
+    decltype(wad.sprites) sprites{};
+
+    /* a truncated file will run off the end of the cursor */
+    try
+    {
+        LumpCursor cursor{file->data(), file->size(), "WAC"};
+        if (!readcacheheader(cursor, WAC_MAGIC, WAC_VERSION, key))
+        {
+            return false;
+        }
+
+        palettes = readvalue<decltype(palettes)>(cursor);
+        colormaps = readvalue<decltype(colormaps)>(cursor);
+
+        /* a name, width, height and pixels */
+        uint32_t count = _readcount(cursor, 16);
+        textures.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto name = readstring(cursor);
+            auto &tex = textures[name];
+            tex.width = readvalue<uint32_t>(cursor);
+            tex.height = readvalue<uint32_t>(cursor);
+            readvector(cursor, tex.pixels);
+        }
+
+        /* flats and sprites are stored once per distinct image,
+         * followed by the names which share each one */
+        auto readshared = [&cursor](auto &map, size_t least, auto read)
+        {
+            using T = typename std::remove_reference<
+                decltype(map)>::type::mapped_type::element_type;
+
+            uint32_t count = _readcount(cursor, least);
+            std::vector<std::shared_ptr<T>> images{};
+            images.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                images.push_back(std::make_shared<T>(read()));
+            }
+
+            /* a name and an index */
+            count = _readcount(cursor, 8);
+            map.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto name = readstring(cursor);
+                map[name] = images.at(readvalue<uint32_t>(cursor));
+            }
+        };
+
+        readshared(
+            flats,
+            sizeof(Flat),
+            [&cursor]()
+            {
+                return readvalue<Flat>(cursor);
+            });
+        /* the size, offsets and three vectors */
+        readshared(
+            sprites,
+            20,
+            [&cursor]()
+            {
+                PostPicture sprite{};
+                sprite.width = readvalue<uint16_t>(cursor);
+                sprite.height = readvalue<uint16_t>(cursor);
+                sprite.left = readvalue<int16_t>(cursor);
+                sprite.top = readvalue<int16_t>(cursor);
+                readvector(cursor, sprite.columns);
+                readvector(cursor, sprite.posts);
+                readvector(cursor, sprite.indices);
+                return sprite;
+            });
+    }
+    catch (std::out_of_range &e)
+    {
+        return false;
+    }
+
+    wad.palettes = palettes;
+    wad.colormaps = colormaps;
+    wad.textures = std::move(textures);
+    wad.flats = std::move(flats);
+    wad.sprites = std::move(sprites);
+    return true;
+}
+
+void saveassetcache(uint64_t key, WAD const &wad)
+{
+    auto path = assetcachepath(key);
+    FILE *f = createcache(path, WAC_MAGIC, WAC_VERSION, key);
+    if (f == nullptr)
+    {
+        return;
+    }
+
+    writevalue(f, wad.palettes);
+    writevalue(f, wad.colormaps);
+
+    writevalue<uint32_t>(f, wad.textures.size());
+    for (auto &pair : wad.textures)
+    {
+        writestring(f, pair.first);
+        writevalue<uint32_t>(f, pair.second.width);
+        writevalue<uint32_t>(f, pair.second.height);
+        writevector(f, pair.second.pixels);
+    }
+
+    auto writeshared = [f](auto const &map, auto write)
+    {
+        std::unordered_map<void const *, uint32_t> index{};
+        std::vector<decltype(map.begin()->second.get())> images{};
+        for (auto &pair : map)
+        {
+            if (index.emplace(pair.second.get(), images.size()).second)
+            {
+                images.push_back(pair.second.get());
+            }
+        }
+
+        writevalue<uint32_t>(f, images.size());
+        for (auto image : images)
+        {
+            write(*image);
+        }
+
+        writevalue<uint32_t>(f, map.size());
+        for (auto &pair : map)
+        {
+            writestring(f, pair.first);
+            writevalue<uint32_t>(f, index[pair.second.get()]);
+        }
+    };
+
+    writeshared(
+        wad.flats,
+        [f](Flat const &flat)
+        {
+            writevalue(f, flat);
+        });
+    writeshared(
+        wad.sprites,
+        [f](PostPicture const &sprite)
+        {
+            writevalue(f, sprite.width);
+            writevalue(f, sprite.height);
+            writevalue(f, sprite.left);
+            writevalue(f, sprite.top);
+            writevector(f, sprite.columns);
+            writevector(f, sprite.posts);
+            writevector(f, sprite.indices);
+        });
+
+    closecache(f, path);
+}
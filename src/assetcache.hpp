@@ -0,0 +1,41 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _ASSETCACHE_H
+#define _ASSETCACHE_H
+
+#include "wad.hpp"
+
+#include <cstdint>
+
+#include <string>
+
+
+/* Asset cache:
+ *  A .wac file holds everything readwad decodes (the palettes and
+ *  colormaps, the composited textures, the flats and the sprites) for one IWAD+PWAD
+ *  load order. Files are named after a hash of the merged directory,
+ *  the lumps textures are defined by and the size and modification
+ *  time of each .WAD, so loading different PWADs, loading them in a
+ *  different order or editing one just misses the cache. */
+
+/* hash of the WAD's directory, texture definitions and files */
+uint64_t assetkey(WAD &wad);
+
+/* path of the .wac file for 'key' */
+std::string assetcachepath(uint64_t key);
+
+/* fill in wad.palettes, colormaps, textures, flats and sprites from
+ * the cache,
+ * returns false on a miss (the WAD is left alone)
+ * (pnames and patches aren't set, they're only needed to build
+ *  textures, which is what the cache saves doing) */
+bool loadassetcache(uint64_t key, WAD &wad);
+
+/* write the cache file for 'key'
+ * (failing to write it isn't an error, it's just a cache) */
+void saveassetcache(uint64_t key, WAD const &wad);
+
+
+#endif
@@ -0,0 +1,176 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "atlas.hpp"
+
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+
+
+
+Atlas::Atlas(size_t size)
+:   _size{size}
+,   _skylines{}
+,   _layers{}
+{
+}
+
+
+size_t Atlas::size(void) const
+{
+    return _size;
+}
+
+size_t Atlas::layers(void) const
+{
+    return _layers.size();
+}
+
+IndexedPixel const *Atlas::layer(size_t index) const
+{
+    return _layers.at(index).data();
+}
+
+
+Atlas::Rect Atlas::add(
+    size_t width,
+    size_t height,
+    IndexedPixel const *pixels)
+{
+    if (width == 0 || height == 0 || width > _size || height > _size)
+    {
+        throw std::length_error{"Image doesn't fit in an atlas layer"};
+    }
+
+    size_t layer = 0;
+    size_t x = 0,
+           y = 0;
+    for (; layer < _layers.size(); ++layer)
+    {
+        if (_fit(layer, width, height, x, y))
+        {
+            break;
+        }
+    }
+    if (layer == _layers.size())
+    {
+        _skylines.push_back({Segment{0, 0, _size}});
+        _layers.emplace_back(_size * _size, IndexedPixel{0, 0, {0, 0}});
+        x = 0;
+        y = 0;
+    }
+
+    _place(layer, x, y, width, height);
+
+    auto dst = _layers[layer].data() + y * _size + x;
+    for (size_t row = 0; row < height; ++row)
+    {
+        memcpy(
+            dst + row * _size,
+            pixels + row * width,
+            width * sizeof(IndexedPixel));
+    }
+
+    return Rect{
+        static_cast<uint16_t>(layer),
+        static_cast<uint16_t>(x),
+        static_cast<uint16_t>(y),
+        static_cast<uint16_t>(width),
+        static_cast<uint16_t>(height)};
+}
+
+
+bool Atlas::_fit(
+    size_t layer,
+    size_t width,
+    size_t height,
+    size_t &x,
+    size_t &y) const
+{
+    auto const &skyline = _skylines[layer];
+
+    bool found = false;
+    size_t best_y = _size,
+           best_x = _size;
+    for (size_t i = 0; i < skyline.size(); ++i)
+    {
+        size_t const left = skyline[i].x;
+        if (left + width > _size)
+        {
+            break;
+        }
+
+        /* the image rests on the highest segment it spans */
+        size_t top = 0;
+        for (size_t j = i;
+             j < skyline.size() && skyline[j].x < left + width;
+             ++j)
+        {
+            top = std::max(top, skyline[j].y);
+        }
+
+        if (top + height <= _size && top < best_y)
+        {
+            found = true;
+            best_y = top;
+            best_x = left;
+        }
+    }
+
+    x = best_x;
+    y = best_y;
+    return found;
+}
+
+
+void Atlas::_place(size_t layer, size_t x, size_t y, size_t w, size_t h)
+{
+    auto &skyline = _skylines[layer];
+
+    std::vector<Segment> out{};
+    out.reserve(skyline.size() + 2);
+    bool placed = false;
+    for (auto &segment : skyline)
+    {
+        size_t const end = segment.x + segment.width;
+        if (end <= x || segment.x >= x + w)
+        {
+            out.push_back(segment);
+            continue;
+        }
+
+        /* keep whatever sticks out either side of the image */
+        if (segment.x < x)
+        {
+            out.push_back(Segment{segment.x, segment.y, x - segment.x});
+        }
+        if (!placed)
+        {
+            out.push_back(Segment{x, y + h, w});
+            placed = true;
+        }
+        if (end > x + w)
+        {
+            out.push_back(Segment{x + w, segment.y, end - (x + w)});
+        }
+    }
+
+    /* merge neighbours of the same height */
+    skyline.clear();
+    for (auto &segment : out)
+    {
+        if (   !skyline.empty()
+            && skyline.back().y == segment.y
+            && skyline.back().x + skyline.back().width == segment.x)
+        {
+            skyline.back().width += segment.width;
+        }
+        else
+        {
+            skyline.push_back(segment);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _ATLAS_H
+#define _ATLAS_H
+
+#include "wad.hpp"
+
+#include <cstdint>
+
+#include <vector>
+
+
+/* packs indexed-color images into a few square layers, which are
+ * meant to be uploaded as one array texture
+ * (a skyline packer: each layer tracks the height of the packed
+ *  area across its width, and each image goes wherever it sits
+ *  lowest. Adding images tallest first packs best) */
+class Atlas
+{
+public:
+    /* where an image was put, in texels
+     * (the atlas can't wrap an image for you, so anything drawing
+     *  from it wraps texture coordinates into the rect itself) */
+    struct Rect
+    {
+        uint16_t layer;
+        uint16_t x, y;
+        uint16_t width, height;
+    };
+
+
+    /* width and height of every layer */
+    size_t size(void) const;
+
+    /* number of layers so far */
+    size_t layers(void) const;
+
+    /* a layer's pixels, row by row */
+    IndexedPixel const *layer(size_t index) const;
+
+    /* add an image
+     * (throws std::length_error if it's bigger than a layer) */
+    Rect add(size_t width, size_t height, IndexedPixel const *pixels);
+
+
+    Atlas(size_t size=1024);
+
+private:
+    /* a span of the skyline */
+    struct Segment
+    {
+        size_t x, y, width;
+    };
+
+    size_t _size;
+    std::vector<std::vector<Segment>> _skylines;
+    std::vector<std::vector<IndexedPixel>> _layers;
+
+    /* find the lowest spot for a width*height image in a layer
+     * (returns false if it doesn't fit) */
+    bool _fit(
+        size_t layer,
+        size_t width,
+        size_t height,
+        size_t &x,
+        size_t &y) const;
+
+    /* raise the skyline over a newly placed image */
+    void _place(size_t layer, size_t x, size_t y, size_t w, size_t h);
+};
+
+
+#endif
@@ -0,0 +1,127 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "cachefile.hpp"
+
+#include <cinttypes>
+
+#include <stdexcept>
+
+
+
+/* the structs are stored as-is, so a file must be read back on a
+ * machine with the same byte order */
+static uint32_t const CACHE_BYTEORDER = 0x01020304;
+
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteorder;
+    uint32_t reserved;
+    uint64_t key;
+};
+
+
+
+uint64_t fnv1a(uint64_t hash, void const *data, size_t size)
+{
+    auto bytes = static_cast<uint8_t const *>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string cachepath(uint64_t key, char const *extension)
+{
+    char name[40];
+    snprintf(name, sizeof(name), "cache/%016" PRIx64 ".%s", key, extension);
+    return std::string{name};
+}
+
+
+void writestring(FILE *f, std::string const &str)
+{
+    writevalue<uint32_t>(f, str.size());
+    fwrite(str.data(), 1, str.size(), f);
+}
+
+std::string readstring(LumpCursor &cursor)
+{
+    auto length = readvalue<uint32_t>(cursor);
+    auto chars = cursor.take(length);
+    return std::string{reinterpret_cast<char const *>(chars), length};
+}
+
+
+std::shared_ptr<WADFile> mapcache(std::string const &path)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<WADFile> file{};
+    try
+    {
+        file = std::make_shared<WADFile>(f);
+    }
+    catch (std::exception &e)
+    {
+    }
+    fclose(f);
+    return file;
+}
+
+bool readcacheheader(
+    LumpCursor &cursor,
+    char const magic[4],
+    uint32_t version,
+    uint64_t key)
+{
+    CacheHeader header;
+    memcpy(&header, cursor.take(sizeof(header)), sizeof(header));
+    return (   memcmp(header.magic, magic, sizeof(header.magic)) == 0
+            && header.version == version
+            && header.byteorder == CACHE_BYTEORDER
+            && header.key == key);
+}
+
+
+FILE *createcache(
+    std::string const &path,
+    char const magic[4],
+    uint32_t version,
+    uint64_t key)
+{
+    FILE *f = fopen((path + ".tmp").c_str(), "w");
+    if (f == nullptr)
+    {
+        return nullptr;
+    }
+
+    CacheHeader header{};
+    memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = version;
+    header.byteorder = CACHE_BYTEORDER;
+    header.key = key;
+    fwrite(&header, sizeof(header), 1, f);
+    return f;
+}
+
+void closecache(FILE *f, std::string const &path)
+{
+    auto tmppath = path + ".tmp";
+
+    bool ok = !ferror(f);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmppath.c_str(), path.c_str()) != 0)
+    {
+        remove(tmppath.c_str());
+    }
+}
@@ -0,0 +1,107 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _CACHEFILE_H
+#define _CACHEFILE_H
+
+#include "wad.hpp"
+#include "wadfile.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+/* Cache files:
+ *  The on-disk caches (see levelcache.hpp and assetcache.hpp) share a
+ *  header and store everything as raw structs, so a cache file is
+ *  mmap'd and read back with a LumpCursor. Every cache file is named
+ *  after a hash of whatever it was made from, so a stale one is just
+ *  never looked up again. */
+
+/* 64-bit FNV-1a */
+static uint64_t const FNV1A_BASIS = 0xcbf29ce484222325ULL;
+uint64_t fnv1a(uint64_t hash, void const *data, size_t size);
+
+/* path of the cache file for 'key' */
+std::string cachepath(uint64_t key, char const *extension);
+
+/* map a cache file
+ * (returns nullptr if there isn't one) */
+std::shared_ptr<WADFile> mapcache(std::string const &path);
+
+/* read a cache file's header, returns false unless it matches
+ * (throws std::out_of_range if the file's too short) */
+bool readcacheheader(
+    LumpCursor &cursor,
+    char const magic[4],
+    uint32_t version,
+    uint64_t key);
+
+/* open a temporary file next to 'path' and write the header
+ * (returns nullptr if it can't be created) */
+FILE *createcache(
+    std::string const &path,
+    char const magic[4],
+    uint32_t version,
+    uint64_t key);
+
+/* finish writing a cache file, moving it into place if nothing went
+ * wrong (so nobody can ever read a half-written one) */
+void closecache(FILE *f, std::string const &path);
+
+
+/* strings are stored as a uint32 length and the characters */
+void writestring(FILE *f, std::string const &str);
+std::string readstring(LumpCursor &cursor);
+
+
+/* single values are stored as-is too */
+template<typename T>
+void writevalue(FILE *f, T const &value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "");
+
+    fwrite(&value, sizeof(T), 1, f);
+}
+
+template<typename T>
+T readvalue(LumpCursor &cursor)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "");
+
+    T value;
+    memcpy(&value, cursor.take(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template<typename T>
+void writevector(FILE *f, std::vector<T> const &v)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "");
+
+    writevalue<uint32_t>(f, v.size());
+    fwrite(v.data(), sizeof(T), v.size(), f);
+}
+
+template<typename T>
+void readvector(LumpCursor &cursor, std::vector<T> &v)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "");
+
+    /* the bytes are taken before anything's allocated, so a corrupt
+     * count throws std::out_of_range like any other short file */
+    auto count = readvalue<uint32_t>(cursor);
+    auto bytes = cursor.take(count * sizeof(T));
+    v.resize(count);
+    memcpy(v.data(), bytes, count * sizeof(T));
+}
+
+
+#endif
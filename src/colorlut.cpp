@@ -0,0 +1,55 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "colorlut.hpp"
+
+#include <cstring>
+
+
+
+uint8_t const *ColorLUT::color(
+    size_t palette,
+    size_t colormap,
+    uint8_t index) const
+{
+    size_t const row = (palette * COLORMAP_COUNT) + colormap;
+    return &rgba[((row * WIDTH) + index) * 4];
+}
+
+void ColorLUT::colorize(
+    IndexedPixel const *pixels,
+    size_t count,
+    size_t palette,
+    size_t colormap,
+    uint8_t *out) const
+{
+    auto const row = color(palette, colormap, 0);
+    for (size_t i = 0; i < count; ++i, out += 4)
+    {
+        memcpy(out, row + (pixels[i].index * 4), 3);
+        out[3] = pixels[i].alpha;
+    }
+}
+
+
+
+ColorLUT buildcolorlut(WAD const &wad)
+{
+    ColorLUT lut{};
+    lut.rgba.resize(ColorLUT::WIDTH * ColorLUT::HEIGHT * 4);
+
+    auto out = lut.rgba.data();
+    for (auto &palette : wad.palettes)
+    {
+        for (auto &colormap : wad.colormaps)
+        {
+            for (size_t i = 0; i < ColorLUT::WIDTH; ++i, out += 4)
+            {
+                memcpy(out, &palette[colormap[i] * 3], 3);
+                out[3] = 0xFF;
+            }
+        }
+    }
+    return lut;
+}
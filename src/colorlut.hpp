@@ -0,0 +1,50 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _COLORLUT_H
+#define _COLORLUT_H
+
+#include "wad.hpp"
+
+#include <cstdint>
+
+#include <vector>
+
+
+/* COLORMAP and PLAYPAL folded into one true-color table, so turning a
+ * palette index into a color is a single lookup instead of going
+ * through the colormap and then the palette
+ * (the rows are laid out the same as the GPU texture: row
+ *  'palette * COLORMAP_COUNT + colormap' holds 256 RGBA colors) */
+struct ColorLUT
+{
+    static constexpr size_t WIDTH = 256,
+                            HEIGHT = PALETTE_COUNT * COLORMAP_COUNT;
+
+    /* WIDTH * HEIGHT RGBA colors */
+    std::vector<uint8_t> rgba;
+
+
+    /* get the color of 'index' under a palette and colormap */
+    uint8_t const *color(
+        size_t palette,
+        size_t colormap,
+        uint8_t index) const;
+
+    /* write the RGBA colors of 'count' pixels to 'out'
+     * (transparent pixels get an alpha of 0) */
+    void colorize(
+        IndexedPixel const *pixels,
+        size_t count,
+        size_t palette,
+        size_t colormap,
+        uint8_t *out) const;
+};
+
+
+/* build the table from a WAD's palettes and colormaps */
+ColorLUT buildcolorlut(WAD const &wad);
+
+
+#endif
@@ -0,0 +1,117 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "levelcache.hpp"
+
+#include "cachefile.hpp"
+
+#include <cstring>
+
+#include <stdexcept>
+
+
+
+/* bump this whenever the output of readlevel/buildgeometry changes
+ * (the key only covers the map's lumps, so a .wrc made by older code
+ *  would otherwise keep being loaded) */
+static uint32_t const WRC_VERSION = 3;
+static char const WRC_MAGIC[4] = {'W', 'R', 'C', '\0'};
+
+/* the lumps readlevel uses, which are what the key is made from */
+static char const *const LEVEL_LUMPS[] = {
+    "THINGS", "VERTEXES", "SECTORS", "SIDEDEFS",
+    "LINEDEFS", "SEGS", "SSECTORS", "NODES"
+};
+
+
+uint64_t levelkey(WAD &wad, std::string const &map)
+{
+    auto const range = wad.maprange(map);
+
+    uint64_t hash = FNV1A_BASIS;
+    hash = fnv1a(hash, &WRC_VERSION, sizeof(WRC_VERSION));
+    for (auto &name : LEVEL_LUMPS)
+    {
+        auto lump = wad.findlump(name, range.first, range.second);
+        hash = fnv1a(hash, name, strlen(name));
+        hash = fnv1a(hash, &lump.size, sizeof(lump.size));
+        hash = fnv1a(hash, lump.bytes(), lump.size);
+    }
+    return hash;
+}
+
+std::string levelcachepath(uint64_t key)
+{
+    return cachepath(key, "wrc");
+}
+
+bool loadlevelcache(uint64_t key, Level &out, LevelGeometry &geometry)
+{
+    auto file = mapcache(levelcachepath(key));
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    /* a truncated file will run off the end of the cursor */
+    try
+    {
+        LumpCursor cursor{file->data(), file->size(), "WRC"};
+        if (!readcacheheader(cursor, WRC_MAGIC, WRC_VERSION, key))
+        {
+            return false;
+        }
+
+        Level lvl{};
+        LevelGeometry geo{};
+        readvector(cursor, lvl.things);
+        readvector(cursor, lvl.linedefs);
+        readvector(cursor, lvl.sidedefs);
+        readvector(cursor, lvl.vertices);
+        readvector(cursor, lvl.segs);
+        readvector(cursor, lvl.ssectors);
+        readvector(cursor, lvl.nodes);
+        readvector(cursor, lvl.sectors);
+        readvector(cursor, geo.walls);
+        readvector(cursor, geo.flats);
+        readvector(cursor, geo.floor_vertices);
+        readvector(cursor, geo.ceiling_vertices);
+
+        out = std::move(lvl);
+        geometry = std::move(geo);
+    }
+    catch (std::out_of_range &e)
+    {
+        return false;
+    }
+    return true;
+}
+
+void savelevelcache(
+    uint64_t key,
+    Level const &lvl,
+    LevelGeometry const &geometry)
+{
+    auto path = levelcachepath(key);
+    FILE *f = createcache(path, WRC_MAGIC, WRC_VERSION, key);
+    if (f == nullptr)
+    {
+        return;
+    }
+
+    writevector(f, lvl.things);
+    writevector(f, lvl.linedefs);
+    writevector(f, lvl.sidedefs);
+    writevector(f, lvl.vertices);
+    writevector(f, lvl.segs);
+    writevector(f, lvl.ssectors);
+    writevector(f, lvl.nodes);
+    writevector(f, lvl.sectors);
+    writevector(f, geometry.walls);
+    writevector(f, geometry.flats);
+    writevector(f, geometry.floor_vertices);
+    writevector(f, geometry.ceiling_vertices);
+
+    closecache(f, path);
+}
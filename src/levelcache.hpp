@@ -0,0 +1,41 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _LEVELCACHE_H
+#define _LEVELCACHE_H
+
+#include "levelgeometry.hpp"
+#include "wad.hpp"
+
+#include <cstdint>
+
+#include <string>
+
+
+/* Level cache:
+ *  A .wrc file holds a parsed Level and its LevelGeometry, stored as
+ *  the raw structs so it can be mmap'd and copied straight back in.
+ *  Files are named after a hash of the map's lumps, so editing the
+ *  map (or loading a PWAD which replaces it) just misses the cache. */
+
+/* hash of the lumps readlevel uses for 'map'
+ * (throws std::out_of_range if there's no such map) */
+uint64_t levelkey(WAD &wad, std::string const &map);
+
+/* path of the .wrc file for 'key' */
+std::string levelcachepath(uint64_t key);
+
+/* load the cached level for 'key', returns false on a miss
+ * (out.wad isn't set) */
+bool loadlevelcache(uint64_t key, Level &out, LevelGeometry &geometry);
+
+/* write the cache file for 'key'
+ * (failing to write it isn't an error, it's just a cache) */
+void savelevelcache(
+    uint64_t key,
+    Level const &lvl,
+    LevelGeometry const &geometry);
+
+
+#endif
@@ -0,0 +1,614 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "levelgeometry.hpp"
+
+#include "threadpool.hpp"
+#include "triangulate.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+
+
+/* make a WallQuad spanning the SEG from 'bot' to 'top' */
+static WallQuad _wallquad(
+    Level const &lvl,
+    size_t seg_idx,
+    WallPart part,
+    char const *texture,
+    int bot, int top,
+    double sx, double sy,
+    double ex, double ey)
+{
+    auto &seg = lvl.segs[seg_idx];
+    auto &start = lvl.start(seg),
+         &end = lvl.end(seg);
+
+    WallQuad quad{};
+    quad.seg = seg_idx;
+    quad.part = part;
+    strncpy(quad.texture, texture, 8);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wnarrowing"
+    quad.vertices[0] = {-start.x,bot,start.y, sx,ey};
+    quad.vertices[1] = {-end.x  ,bot,end.y  , ex,ey};
+    quad.vertices[2] = {-end.x  ,top,end.y  , ex,sy};
+    quad.vertices[3] = {-start.x,top,start.y, sx,sy};
+#pragma GCC diagnostic pop
+    return quad;
+}
+
+
+
+/* a point of a SSECTOR's polygon */
+struct _FlatPoint
+{
+    double x, y;
+};
+
+/* clip a convex polygon to the right of a line (the front side, going
+ * by Doom's BSP), keeping anything within 'slack' of it */
+static std::vector<_FlatPoint> _clip(
+    std::vector<_FlatPoint> const &polygon,
+    double x, double y,
+    double dx, double dy,
+    double slack)
+{
+    double const length = sqrt((dx * dx) + (dy * dy));
+    if (length == 0 || polygon.empty())
+    {
+        return polygon;
+    }
+
+    /* distance to the left of the line */
+    auto distance = [&](_FlatPoint const &p)
+    {
+        return ((dx * (p.y - y)) - (dy * (p.x - x))) / length;
+    };
+
+    std::vector<_FlatPoint> out{};
+    for (size_t i = 0; i < polygon.size(); ++i)
+    {
+        auto &a = polygon[i],
+             &b = polygon[(i + 1) % polygon.size()];
+        double const da = distance(a),
+                     db = distance(b);
+
+        if (da <= slack)
+        {
+            out.push_back(a);
+        }
+        if ((da < -slack && db > slack) || (da > slack && db < -slack))
+        {
+            double const t = da / (da - db);
+            out.push_back({a.x + (t * (b.x - a.x)), a.y + (t * (b.y - a.y))});
+        }
+    }
+    return out;
+}
+
+/* get the convex polygon of every SSECTOR, counterclockwise
+ * (each starts as the whole map, which is cut down by the partition
+ *  lines on the way to it through the BSP tree, then by its own SEGs,
+ *  so it's one pass over the tree. The SEG clipping is done across the
+ *  thread pool. SSECTORs which come out degenerate get an empty
+ *  polygon) */
+static std::vector<std::vector<_FlatPoint>> _ssectorpolygons(
+    Level const &lvl)
+{
+    std::vector<std::vector<_FlatPoint>> polygons(lvl.ssectors.size());
+    if (lvl.vertices.empty() || lvl.ssectors.empty())
+    {
+        return polygons;
+    }
+
+    double minx = lvl.vertices[0].x, maxx = minx,
+           miny = lvl.vertices[0].y, maxy = miny;
+    for (auto &v : lvl.vertices)
+    {
+        minx = std::min<double>(minx, v.x);
+        maxx = std::max<double>(maxx, v.x);
+        miny = std::min<double>(miny, v.y);
+        maxy = std::max<double>(maxy, v.y);
+    }
+    std::vector<_FlatPoint> const map{
+        {minx - 64, miny - 64},
+        {maxx + 64, miny - 64},
+        {maxx + 64, maxy + 64},
+        {minx - 64, maxy + 64}};
+
+    /* node builders round the vertices they split SEGs at, so SEGs can
+     * be a little off the partition lines. Keeping a little slack
+     * means neighbouring SSECTORs overlap a bit instead of leaving
+     * cracks between them */
+    auto leaf = [&lvl, &polygons](
+        size_t index,
+        std::vector<_FlatPoint> polygon)
+    {
+        auto &ssector = lvl.ssectors[index];
+        for (size_t i = ssector.start;
+             i < (size_t)ssector.start + ssector.count && i < lvl.segs.size();
+             ++i)
+        {
+            auto &start = lvl.start(lvl.segs[i]),
+                 &end = lvl.end(lvl.segs[i]);
+            polygon = _clip(
+                polygon,
+                start.x, start.y,
+                end.x - start.x, end.y - start.y,
+                0.5);
+        }
+
+        /* drop points on top of each other */
+        std::vector<_FlatPoint> out{};
+        for (auto &p : polygon)
+        {
+            if (   out.empty()
+                || fabs(p.x - out.back().x) > 0.001
+                || fabs(p.y - out.back().y) > 0.001)
+            {
+                out.push_back(p);
+            }
+        }
+        while (   out.size() > 1
+               && fabs(out.front().x - out.back().x) <= 0.001
+               && fabs(out.front().y - out.back().y) <= 0.001)
+        {
+            out.pop_back();
+        }
+
+        double area = 0;
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            auto &a = out[i],
+                 &b = out[(i + 1) % out.size()];
+            area += (a.x * b.y) - (a.y * b.x);
+        }
+        if (out.size() >= 3 && area > 0.01)
+        {
+            polygons[index] = std::move(out);
+        }
+    };
+
+    /* each SSECTOR's part of the map, from the partition lines alone */
+    std::vector<std::vector<_FlatPoint>> regions(lvl.ssectors.size());
+
+    /* a level with a single SSECTOR doesn't need any nodes */
+    if (lvl.nodes.empty())
+    {
+        regions[0] = map;
+    }
+
+    /* each NODE is only gone into once, so a tree which loops back on
+     * itself can't keep this going forever */
+    std::vector<bool> visited(lvl.nodes.size(), false);
+    std::vector<std::pair<uint16_t, std::vector<_FlatPoint>>> stack{};
+    if (!lvl.nodes.empty())
+    {
+        stack.push_back({lvl.nodes.size() - 1, map});
+    }
+    while (!stack.empty())
+    {
+        auto index = stack.back().first;
+        auto polygon = std::move(stack.back().second);
+        stack.pop_back();
+
+        if (index & 0x8000)
+        {
+            if ((index & 0x7FFF) < regions.size())
+            {
+                regions[index & 0x7FFF] = std::move(polygon);
+            }
+            continue;
+        }
+        if (index >= lvl.nodes.size() || visited[index])
+        {
+            continue;
+        }
+        visited[index] = true;
+
+        /* nothing below a side which was clipped down to less than a
+         * triangle has any area */
+        auto &node = lvl.nodes[index];
+        auto right = _clip(polygon, node.x, node.y, node.dx, node.dy, 0.0);
+        auto left = _clip(polygon, node.x, node.y, -node.dx, -node.dy, 0.0);
+        if (right.size() >= 3)
+        {
+            stack.push_back({node.right, std::move(right)});
+        }
+        if (left.size() >= 3)
+        {
+            stack.push_back({node.left, std::move(left)});
+        }
+    }
+
+    ThreadPool::global().parallel_for(
+        regions.size(),
+        [&leaf, &regions](size_t i)
+        {
+            leaf(i, std::move(regions[i]));
+        });
+    return polygons;
+}
+
+
+/* a SECTOR's edges, each going from .first to .second with the
+ * SECTOR on its right */
+typedef std::vector<std::pair<Vertex, Vertex>> _Lines;
+
+/* sort the LINEDEFs into the SECTORs they bound, in one pass */
+static std::vector<_Lines> _sectorlines(Level const &lvl)
+{
+    std::vector<_Lines> lines(lvl.sectors.size());
+    for (auto &linedef : lvl.linedefs)
+    {
+        auto right = lvl.right(linedef)->sector;
+        if (right < lines.size())
+        {
+            lines[right].push_back({lvl.start(linedef), lvl.end(linedef)});
+        }
+        if (   (linedef.flags & TWOSIDED)
+            && lvl.left(linedef) != nullptr)
+        {
+            auto left = lvl.left(linedef)->sector;
+            if (left != right && left < lines.size())
+            {
+                lines[left].push_back(
+                    {lvl.end(linedef), lvl.start(linedef)});
+            }
+        }
+    }
+    return lines;
+}
+
+/* key for looking an edge up by its start point */
+static uint32_t _pointkey(Vertex const &v)
+{
+    return ((uint32_t)(uint16_t)v.x << 16) | (uint16_t)v.y;
+}
+
+/* triangulate a SECTOR's outline, as loops of its LINEDEFs
+ * (returns nothing if it couldn't be triangulated) */
+static std::vector<std::array<glm::vec2, 3>> _outlinetriangles(
+    _Lines const &lines)
+{
+    /* edges by their start points, so each step of a loop is a lookup */
+    std::unordered_map<uint32_t, std::vector<size_t>> from{};
+    from.reserve(lines.size());
+    for (size_t i = lines.size(); i-- > 0;)
+    {
+        from[_pointkey(lines[i].first)].push_back(i);
+    }
+
+    /* create lists of connected vertices in the sector */
+    /* TODO: there can be shared vertices? */
+    std::vector<bool> used(lines.size(), false);
+    std::vector<std::vector<Vertex>> loops{};
+    for (size_t i = lines.size(); i-- > 0;)
+    {
+        if (used[i])
+        {
+            continue;
+        }
+        used[i] = true;
+
+        std::vector<Vertex> loop{};
+        loop.push_back(lines[i].first);
+        loop.push_back(lines[i].second);
+        for (;;)
+        {
+            auto it = from.find(_pointkey(loop.back()));
+            if (it == from.end())
+            {
+                break;
+            }
+
+            auto &next = it->second;
+            while (!next.empty() && used[next.back()])
+            {
+                next.pop_back();
+            }
+            if (next.empty())
+            {
+                break;
+            }
+
+            used[next.back()] = true;
+            loop.push_back(lines[next.back()].second);
+            next.pop_back();
+        }
+        loops.push_back(loop);
+    }
+
+    auto indices = triangulate(loops);
+
+    std::vector<Vertex> points{};
+    for (auto &loop : loops)
+    {
+        points.insert(points.end(), loop.begin(), loop.end());
+    }
+
+    std::vector<std::array<glm::vec2, 3>> triangles{};
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        auto &p0 = points[indices[i + 0]],
+             &p1 = points[indices[i + 1]],
+             &p2 = points[indices[i + 2]];
+        triangles.push_back({
+            glm::vec2{p0.x, p0.y},
+            glm::vec2{p1.x, p1.y},
+            glm::vec2{p2.x, p2.y}});
+    }
+    return triangles;
+}
+
+/* add a flat's triangles to the geometry */
+static void _storeflat(
+    Level const &lvl,
+    uint32_t sector_idx,
+    uint32_t ssector,
+    std::vector<std::array<glm::vec2, 3>> const &triangles,
+    LevelGeometry &out)
+{
+    if (triangles.empty())
+    {
+        return;
+    }
+
+    auto &sector = lvl.sectors[sector_idx];
+
+    FlatGeometry flat{};
+    flat.sector = sector_idx;
+    flat.ssector = ssector;
+    flat.first = out.floor_vertices.size();
+    flat.count = triangles.size() * 3;
+
+    std::vector<GeometryVertex> cverts{};
+    for (auto &tri : triangles)
+    {
+        auto &p0 = tri[0],
+             &p1 = tri[1],
+             &p2 = tri[2];
+
+        float fl = sector.floor,
+              cl = sector.ceiling;
+
+        out.floor_vertices.push_back({-p0.x,fl,p0.y, p0.x/64.f,p0.y/64.f});
+        out.floor_vertices.push_back({-p1.x,fl,p1.y, p1.x/64.f,p1.y/64.f});
+        out.floor_vertices.push_back({-p2.x,fl,p2.y, p2.x/64.f,p2.y/64.f});
+
+        cverts.push_back({-p0.x,cl,p0.y, p0.x/64.f,p0.y/64.f});
+        cverts.push_back({-p1.x,cl,p1.y, p1.x/64.f,p1.y/64.f});
+        cverts.push_back({-p2.x,cl,p2.y, p2.x/64.f,p2.y/64.f});
+    }
+
+    std::reverse(std::begin(cverts), std::end(cverts));
+    out.ceiling_vertices.insert(
+        out.ceiling_vertices.end(),
+        cverts.begin(),
+        cverts.end());
+    out.flats.push_back(flat);
+}
+
+
+/* make the WallQuads for a SEG */
+static void _segwalls(
+    Level const &lvl,
+    size_t seg_idx,
+    std::vector<WallQuad> &walls)
+{
+    auto &seg = lvl.segs[seg_idx];
+    auto &ld = lvl.linedefs[seg.linedef];
+    auto side = lvl.front(seg);
+    auto opp  = lvl.back(seg);
+    auto sector    = &lvl.sector(*side);
+    auto oppsector = opp? &lvl.sector(*opp) : nullptr;
+
+    double const len =\
+        sqrt(
+            pow(lvl.end(seg).x - lvl.start(seg).x, 2)
+            + pow(lvl.end(seg).y - lvl.start(seg).y, 2));
+
+    /* middle */
+    if (strcmp(side->middle, "-") != 0)
+    {
+        bool twosided = ld.flags & TWOSIDED;
+        bool unpegged = ld.flags & UNPEGGEDLOWER;
+
+        int top = sector->ceiling;
+        int bot = sector->floor;
+
+        if (twosided)
+        {
+            if (sector->floor < oppsector->floor)
+            {
+                bot = oppsector->floor;
+            }
+            if (sector->ceiling > oppsector->ceiling)
+            {
+                top = oppsector->ceiling;
+            }
+        }
+
+        double hgt = abs(top - bot);
+        double sx = seg.offset + side->x,
+               sy = side->y + (unpegged? -hgt : 0);
+
+        walls.push_back(
+            _wallquad(
+                lvl, seg_idx, WALL_MIDDLE, side->middle,
+                bot, top,
+                sx, sy,
+                sx + len, sy + hgt));
+    }
+    if (ld.flags & TWOSIDED)
+    {
+        /* lower section */
+        if (   sector->floor < oppsector->floor
+            && !(strcmp(sector->floor_flat, "F_SKY1") == 0
+                && strcmp(oppsector->floor_flat, "F_SKY1") == 0)
+            && strcmp(side->lower, "-") != 0)
+        {
+            int top = oppsector->floor;
+            int bot = sector->floor;
+
+            double hgt = abs(top - bot);
+
+            bool unpegged = ld.flags & UNPEGGEDLOWER;
+            double sx = seg.offset + side->x,
+                   sy = side->y;
+            double ex = sx + len,
+                   ey = sy + hgt;
+
+            if (unpegged)
+            {
+                double offset =\
+                    glm::max(sector->ceiling, oppsector->ceiling)
+                    - top;
+                sy += offset;
+                ey += offset;
+            }
+
+            walls.push_back(
+                _wallquad(
+                    lvl, seg_idx, WALL_LOWER, side->lower,
+                    bot, top,
+                    sx, sy,
+                    ex, ey));
+        }
+        /* upper section */
+        if (   sector->ceiling > oppsector->ceiling
+            && !(strcmp(sector->ceiling_flat, "F_SKY1") == 0
+                && strcmp(oppsector->ceiling_flat, "F_SKY1") == 0)
+            && strcmp(side->upper, "-") != 0)
+        {
+            int top = sector->ceiling;
+            int bot = oppsector->ceiling;
+
+            double hgt = abs(top - bot);
+
+            bool unpegged = ld.flags & UNPEGGEDUPPER;
+            double sx = seg.offset + side->x,
+                   sy = side->y + (unpegged? 0 : -hgt);
+
+            walls.push_back(
+                _wallquad(
+                    lvl, seg_idx, WALL_UPPER, side->upper,
+                    bot, top,
+                    sx, sy,
+                    sx + len, sy + hgt));
+        }
+    }
+}
+
+
+LevelGeometry buildgeometry(Level const &lvl)
+{
+    LevelGeometry out{};
+    auto &pool = ThreadPool::global();
+
+    /* /+========================================================+\ */
+    /* ||                         WALLS                          || */
+    /* \+========================================================+/ */
+    /* create WallQuads from the segs, in parallel, then put them
+     * together in SEG order */
+    std::vector<std::vector<WallQuad>> walls(lvl.segs.size());
+    pool.parallel_for(
+        lvl.segs.size(),
+        [&lvl, &walls](size_t i)
+        {
+            _segwalls(lvl, i, walls[i]);
+        });
+    for (auto &w : walls)
+    {
+        out.walls.insert(out.walls.end(), w.begin(), w.end());
+    }
+
+    /* /+========================================================+\ */
+    /* ||                         FLATS                          || */
+    /* \+========================================================+/ */
+    /* SSECTORs are convex, so their flats are just fans. A SECTOR is
+     * only drawn from its SSECTORs if every one of them came out,
+     * otherwise its outline is triangulated instead */
+    auto polygons = _ssectorpolygons(lvl);
+    auto lines = _sectorlines(lvl);
+
+    std::vector<std::vector<uint32_t>> ssectors(lvl.sectors.size());
+    std::vector<bool> usable(lvl.sectors.size(), true);
+    for (size_t i = 0; i < lvl.ssectors.size(); ++i)
+    {
+        auto &ssector = lvl.ssectors[i];
+        if (ssector.count == 0 || ssector.start >= lvl.segs.size())
+        {
+            continue;
+        }
+
+        auto sector = lvl.front(lvl.segs[ssector.start])->sector;
+        ssectors[sector].push_back(i);
+        if (polygons[i].size() < 3)
+        {
+            usable[sector] = false;
+        }
+    }
+
+    /* each SECTOR is built on its own, in parallel, then they're put
+     * together in SECTOR order */
+    std::vector<LevelGeometry> sectors(lvl.sectors.size());
+    pool.parallel_for(
+        lvl.sectors.size(),
+        [&](size_t sector_idx)
+        {
+            auto &part = sectors[sector_idx];
+            if (!usable[sector_idx] || ssectors[sector_idx].empty())
+            {
+                _storeflat(
+                    lvl, sector_idx, NO_SSECTOR,
+                    _outlinetriangles(lines[sector_idx]),
+                    part);
+                return;
+            }
+
+            for (auto ssector : ssectors[sector_idx])
+            {
+                auto &polygon = polygons[ssector];
+
+                std::vector<std::array<glm::vec2, 3>> triangles{};
+                for (size_t i = 1; i + 1 < polygon.size(); ++i)
+                {
+                    triangles.push_back({
+                        glm::vec2{polygon[0].x, polygon[0].y},
+                        glm::vec2{polygon[i].x, polygon[i].y},
+                        glm::vec2{polygon[i + 1].x, polygon[i + 1].y}});
+                }
+                _storeflat(lvl, sector_idx, ssector, triangles, part);
+            }
+        });
+    for (auto &part : sectors)
+    {
+        uint32_t const first = out.floor_vertices.size();
+        for (auto flat : part.flats)
+        {
+            flat.first += first;
+            out.flats.push_back(flat);
+        }
+        out.floor_vertices.insert(
+            out.floor_vertices.end(),
+            part.floor_vertices.begin(),
+            part.floor_vertices.end());
+        out.ceiling_vertices.insert(
+            out.ceiling_vertices.end(),
+            part.ceiling_vertices.begin(),
+            part.ceiling_vertices.end());
+    }
+
+    return out;
+}
@@ -0,0 +1,79 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _LEVELGEOMETRY_H
+#define _LEVELGEOMETRY_H
+
+#include "wad.hpp"
+
+#include <cstdint>
+
+#include <vector>
+
+
+/* The walls and flats of a level, without any OpenGL objects.
+ * RenderLevel turns this into Meshes, and it can be cached on disk
+ * (see levelcache.hpp), so everything in here is trivially copyable. */
+
+struct GeometryVertex
+{
+    float x, y, z;
+    float s, t;
+};
+
+enum WallPart
+{
+    WALL_MIDDLE,
+    WALL_UPPER,
+    WALL_LOWER,
+};
+
+/* one section of a wall
+ * (the texture coordinates are in texels, since the size of the
+ *  texture isn't known until it's looked up by name) */
+struct WallQuad
+{
+    /* index of the SEG this is part of */
+    uint32_t seg;
+    /* see WallPart */
+    uint32_t part;
+    /* texture name as it appears in the SIDEDEF */
+    char texture[9];
+    /* drawn as the triangles 0,1,2 and 2,3,0 */
+    GeometryVertex vertices[4];
+};
+
+/* FlatGeometry::ssector of a whole SECTOR's flat */
+static uint32_t const NO_SSECTOR = UINT32_MAX;
+
+/* the floor and ceiling of a SSECTOR
+ * (or of a whole SECTOR, if its SSECTORs couldn't be used) */
+struct FlatGeometry
+{
+    /* index of the SECTOR */
+    uint32_t sector;
+    /* index of the SSECTOR, or NO_SSECTOR */
+    uint32_t ssector;
+    /* range of vertices in floor_vertices/ceiling_vertices */
+    uint32_t first, count;
+};
+
+struct LevelGeometry
+{
+    std::vector<WallQuad> walls;
+    /* grouped by SECTOR, so each SECTOR's vertices are contiguous
+     * (only SECTORs which could be triangulated have any) */
+    std::vector<FlatGeometry> flats;
+    std::vector<GeometryVertex> floor_vertices,
+                                ceiling_vertices;
+};
+
+
+/* build the geometry for a level
+ * (the work is spread across the thread pool, and nothing here touches
+ *  GL, so it doesn't have to be called from the GL thread) */
+LevelGeometry buildgeometry(Level const &lvl);
+
+
+#endif
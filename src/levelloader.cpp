@@ -0,0 +1,124 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "levelloader.hpp"
+
+#include "levelcache.hpp"
+#include "levelgeometry.hpp"
+#include "readwad.hpp"
+
+#include <cstdio>
+
+#include <stdexcept>
+
+
+
+LevelLoader::LevelLoader()
+:   _thread{},
+    _finished{false},
+    _level{nullptr},
+    _renderlevel{nullptr},
+    _error{nullptr}
+{
+}
+
+LevelLoader::~LevelLoader()
+{
+    wait();
+}
+
+
+
+void LevelLoader::start(
+    std::string const &name,
+    WAD &wad,
+    RenderGlobals const &g,
+    uint8_t include,
+    uint8_t exclude)
+{
+    if (busy())
+    {
+        throw std::logic_error{
+            "LevelLoader: " + name + " started before the last level"
+            " was taken"};
+    }
+
+    _finished = false;
+    _error = nullptr;
+    _thread = std::thread{
+        [this, name, &wad, &g, include, exclude]()
+        {
+            try
+            {
+                std::unique_ptr<Level> level{new Level{}};
+
+                /* use the cached level if the map hasn't changed */
+                auto key = levelkey(wad, name);
+                LevelGeometry geometry{};
+                if (loadlevelcache(key, *level, geometry))
+                {
+                    printf(
+                        "%s: loaded %s\n",
+                        name.c_str(),
+                        levelcachepath(key).c_str());
+                    level->wad = &wad;
+                }
+                else
+                {
+                    *level = readlevel(name, wad);
+                    geometry = buildgeometry(*level);
+                    savelevelcache(key, *level, geometry);
+                }
+                /* composite the level's textures up front, in parallel */
+                prefetchtextures(wad, leveltextures(*level));
+
+                _renderlevel.reset(
+                    new RenderLevel(*level, geometry, g, include, exclude));
+                _level = std::move(level);
+            }
+            catch (...)
+            {
+                _error = std::current_exception();
+            }
+            _finished = true;
+        }};
+}
+
+bool LevelLoader::busy(void) const
+{
+    return _thread.joinable();
+}
+
+bool LevelLoader::finished(void) const
+{
+    return _finished;
+}
+
+void LevelLoader::take(
+    std::unique_ptr<Level> &level,
+    std::unique_ptr<RenderLevel> &renderlevel)
+{
+    if (!busy())
+    {
+        throw std::logic_error{"LevelLoader: nothing to take"};
+    }
+    wait();
+
+    auto error = _error;
+    _error = nullptr;
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    level = std::move(_level);
+    renderlevel = std::move(_renderlevel);
+}
+
+void LevelLoader::wait(void)
+{
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+}
@@ -0,0 +1,73 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _LEVELLOADER_H
+#define _LEVELLOADER_H
+
+#include "renderlevel.hpp"
+#include "wad.hpp"
+
+#include <cstdint>
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+
+
+/* Level loader:
+ *  Reads a level (or its .wrc), builds its geometry, composites its
+ *  textures and makes its RenderLevel on a thread of its own, so the
+ *  current level can keep being drawn meanwhile. What comes out still
+ *  has to be uploaded with RenderLevel::upload on the GL thread.
+ *  While a level's loading, the loader's thread is the only one
+ *  allowed to touch the WAD's textures and map lumps. */
+class LevelLoader
+{
+public:
+
+    /* start loading the map 'name'
+     * (anything loaded before has to have been taken first) */
+    void start(
+        std::string const &name,
+        WAD &wad,
+        RenderGlobals const &g,
+        uint8_t include,
+        uint8_t exclude);
+
+    /* is there a level loading, or loaded but not taken yet? */
+    bool busy(void) const;
+
+    /* has the level finished loading? (doesn't wait) */
+    bool finished(void) const;
+
+    /* wait for the level to finish loading, and take it
+     * (if loading it threw, that's rethrown here instead) */
+    void take(
+        std::unique_ptr<Level> &level,
+        std::unique_ptr<RenderLevel> &renderlevel);
+
+    /* wait for the level to finish loading, without taking it */
+    void wait(void);
+
+
+    LevelLoader();
+    ~LevelLoader();
+
+private:
+    std::thread _thread;
+    std::atomic<bool> _finished;
+
+    std::unique_ptr<Level> _level;
+    std::unique_ptr<RenderLevel> _renderlevel;
+    std::exception_ptr _error;
+
+    /* no copying allowed! */
+    LevelLoader &operator=(LevelLoader const &other) = delete;
+    LevelLoader(LevelLoader const &other) = delete;
+};
+
+
+#endif
@@ -2,12 +2,16 @@
  * See LICENSE file for copyright and license details.
  */
 
+#include "assetcache.hpp"
+#include "atlas.hpp"
 #include "camera.hpp"
+#include "levelloader.hpp"
 #include "mesh.hpp"
 #include "program.hpp"
 #include "readwad.hpp"
 #include "texture.hpp"
 #include "things.hpp"
+#include "wadfile.hpp"
 #include "renderlevel.hpp"
 
 #include <glm/glm.hpp>
@@ -26,7 +30,9 @@
 #include <algorithm>
 #include <deque>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -273,9 +279,17 @@ struct GameState
     uint8_t difficulty;
 
     size_t level_idx;
-    Level level;
+    std::unique_ptr<Level> level;
     std::unique_ptr<RenderLevel> renderlevel;
 
+    /* the level asked for by setlevel, which is loaded in the
+     * background and swapped in once it's uploaded (see updatelevel) */
+    size_t wanted_idx;
+    size_t next_idx;
+    LevelLoader loader;
+    std::unique_ptr<Level> nextlevel;
+    std::unique_ptr<RenderLevel> nextrenderlevel;
+
     State state;
     bool menu_open;
     bool automap_open;
@@ -336,46 +350,70 @@ struct GameState
         transition(state, newmenu);
     }
 
+    /* ask for a level, which is swapped in once it's loaded
+     * (if one's already loading, this one waits its turn. Asking
+     *  again before then just changes which one it'll be) */
     void setlevel(size_t idx)
     {
-        char episode = '0' + ((idx / 10) % 10);
-        char mission = '0' + (idx % 10);
-        std::string name{};
+        wanted_idx = idx;
+        updatelevel(0);
+    }
 
-        if (doom2)
+    /* carry on with loading the level asked for, doing up to 'budget'
+     * of its GL work (see RenderLevel::upload). If 'wait', this waits
+     * for the loader instead of coming back later */
+    void updatelevel(size_t budget, bool wait=false)
+    {
+        if (loader.busy() && (wait || loader.finished()))
         {
-            name =\
-                "MAP"
-                + std::string{episode}
-                + std::string{mission};
+            try
+            {
+                loader.take(nextlevel, nextrenderlevel);
+            }
+            catch (std::exception &e)
+            {
+                fprintf(
+                    stderr,
+                    "%s: %s\n",
+                    _levelname(next_idx).c_str(),
+                    e.what());
+                wanted_idx = level_idx;
+            }
         }
-        else
+
+        if (   nextrenderlevel != nullptr
+            && nextrenderlevel->upload(rndr, budget))
         {
-            name =\
-                "E"
-                + std::string{(char)(episode + 1)}
-                + "M"
-                + std::string{mission};
+            /* the old RenderLevel points at the old Level */
+            renderlevel = std::move(nextrenderlevel);
+            level = std::move(nextlevel);
+            level_idx = next_idx;
+            _spawn();
         }
-        level = readlevel(name, wad);
-        renderlevel.reset(
-            new RenderLevel(level, rndr, difficulty, MP_ONLY));
-        level_idx = idx;
 
-        /* set the camera position to player 1's spawn point */
-        for (auto &thing : level.things)
+        if (   !loader.busy()
+            && nextrenderlevel == nullptr
+            && wanted_idx != level_idx)
         {
-            if (thing.type == 1)
-            {
-                rndr.cam.pos.x = -thing.x;
-                rndr.cam.pos.z = thing.y;
-                rndr.cam.angle.x = thing.angle - 90;
-                rndr.cam.angle.y = 0;
-                break;
-            }
+            next_idx = wanted_idx;
+            loader.start(
+                _levelname(next_idx),
+                wad,
+                rndr,
+                difficulty,
+                MP_ONLY);
         }
     }
 
+    /* load the level asked for, without coming back until it's in */
+    void waitforlevel(void)
+    {
+        do
+        {
+            updatelevel(SIZE_MAX, true);
+        } while (loader.busy() || nextrenderlevel != nullptr);
+    }
+
 
     GameState(
             RenderGlobals &g,
@@ -393,9 +431,15 @@ struct GameState
         difficulty{difficulty},
 
         level_idx{0},
-        level{},
+        level{nullptr},
         renderlevel{nullptr},
 
+        wanted_idx{0},
+        next_idx{0},
+        loader{},
+        nextlevel{nullptr},
+        nextrenderlevel{nullptr},
+
         state{initial},
         menu_open{menu_initial},
         automap_open{false},
@@ -405,16 +449,46 @@ struct GameState
 
         current_menuscreen{""}
     {
-        try
+        /* only Doom II has MAPxx maps */
+        doom2 = wad.haslump("MAP01");
+        transition(initial, menu_initial);
+    }
+
+private:
+    /* get the name of a level, eg. 12 is E2M2 or MAP12 */
+    std::string _levelname(size_t idx) const
+    {
+        char episode = '0' + ((idx / 10) % 10);
+        char mission = '0' + (idx % 10);
+
+        if (doom2)
         {
-            readlevel("MAP01", wad);
-            doom2 = true;
+            return\
+                "MAP"
+                + std::string{episode}
+                + std::string{mission};
         }
-        catch (std::out_of_range &e)
+        return\
+            "E"
+            + std::string{(char)(episode + 1)}
+            + "M"
+            + std::string{mission};
+    }
+
+    /* set the camera position to player 1's spawn point */
+    void _spawn(void)
+    {
+        for (auto &thing : level->things)
         {
-            doom2 = false;
+            if (thing.type == 1)
+            {
+                rndr.cam.pos.x = -thing.x;
+                rndr.cam.pos.z = thing.y;
+                rndr.cam.angle.x = thing.angle - 90;
+                rndr.cam.angle.y = 0;
+                break;
+            }
         }
-        transition(initial, menu_initial);
     }
 };
 
@@ -825,44 +899,95 @@ static std::unique_ptr<Mesh> thingquad{nullptr};
 
 int main(int argc, char *argv[])
 {
-    if (argc <= 1)
+    /* options come before the .WADs */
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (strcmp(argv[arg], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp(argv[arg], "-lumpcache") == 0 && arg + 1 < argc)
+        {
+            /* in MiB (0 = unlimited) */
+            WADFile::budget(
+                strtoull(argv[++arg], nullptr, 10) * 1024 * 1024);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[arg]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (arg >= argc)
     {
-        fprintf(stderr, "No .WAD given!\n");
+        fprintf(stderr,
+            "No .WAD given!\n"
+            "usage: %s [-v] [-lumpcache MiB] IWAD [PWAD...]\n",
+            argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    FILE *wadfile = fopen(argv[1], "r");
+    FILE *wadfile = fopen(argv[arg], "r");
     if (wadfile == nullptr)
     {
         fprintf(stderr, "Failed to open %s -- (%s)\n",
-            argv[1],
+            argv[arg],
             strerror(errno));
         exit(EXIT_FAILURE);
     }
 
     /* read the IWAD */
-    auto wad = loadIWAD(wadfile);
+    auto wad = loadIWAD(wadfile, argv[arg]);
     fclose(wadfile);
 
     /* read PWADs and patch the IWAD */
-    if (argc >= 3)
+    if (arg + 1 < argc)
     {
-        for (int i = 0; i < argc - 2; ++i)
+        std::vector<std::pair<std::string, FILE *>> pwads{};
+        for (int i = arg + 1; i < argc; ++i)
         {
-            FILE *f = fopen(argv[2 + i], "r");
+            FILE *f = fopen(argv[i], "r");
             if (f == nullptr)
             {
                 fprintf(stderr, "Failed to open %s -- (%s)\n",
-                    argv[2 + i],
+                    argv[i],
                     strerror(errno));
                 exit(EXIT_FAILURE);
             }
-            printf("patch: %s\n", argv[2 + i]);
-            patchWAD(wad, f);
-            fclose(f);
+            pwads.push_back({argv[i], f});
+        }
+        patchWADs(wad, pwads);
+        for (auto &pwad : pwads)
+        {
+            fclose(pwad.second);
+        }
+        if (verbose)
+        {
+            printsources(wad);
         }
     }
-    readwad(wad);
+
+    /* use the decoded textures/flats/sprites from last time if the
+     * same WADs were loaded
+     * (textures are composited as levels use them, so anything that
+     *  isn't in the cache yet is built when it's first needed) */
+    auto assets = assetkey(wad);
+    bool assets_cached = loadassetcache(assets, wad);
+    if (assets_cached)
+    {
+        printf("assets: loaded %s\n", assetcachepath(assets).c_str());
+        readtexturedefinitions(wad);
+        buildspriteframes(wad);
+    }
+    else
+    {
+        readwad(wad, true);
+    }
+    /* the sky isn't on any SIDEDEF, so no level will ask for it */
+    gettexture(wad, "SKY1");
+    size_t const cached_textures = assets_cached? wad.textures.size() : 0;
 
 
     RenderGlobals g{};
@@ -952,6 +1077,9 @@ int main(int argc, char *argv[])
     g.automap_program.reset(new Program{
         Shader{GL_VERTEX_SHADER, "shaders/2d-vertex.glvs"},
         Shader{GL_FRAGMENT_SHADER, "shaders/color.glfs"}});
+    g.atlas_program.reset(new Program{
+        Shader{GL_VERTEX_SHADER, "shaders/atlas.glvs"},
+        Shader{GL_FRAGMENT_SHADER, "shaders/atlas.glfs"}});
 
 
     /* screen quad + shader */
@@ -1066,55 +1194,23 @@ int main(int argc, char *argv[])
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
-    /* set up the palette */
+    /* set up the palettes and colormaps
+     * (as one table, so shaders only look a color up once) */
     g.palette_number = 0;
-    auto palette = new uint8_t[14][256][3];
-    for (size_t i = 0; i < 14; ++i)
-    {
-        auto &pal = wad.palettes[i];
-        for (size_t j = 0; j < 256; ++j)
-        {
-            palette[i][j][0] = pal[(j * 3) + 0];
-            palette[i][j][1] = pal[(j * 3) + 1];
-            palette[i][j][2] = pal[(j * 3) + 2];
-        }
-    }
-    glGenTextures(1, &g.palette_texture);
-    glBindTexture(GL_TEXTURE_2D, g.palette_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGB8,
-        256, 14,
-        0,
-        GL_RGB,
-        GL_UNSIGNED_BYTE,
-        palette);
-    delete[] palette;
-
-
-    /* set up the colormap */
-    auto colormap = new uint8_t[256 * 34];
-    DirEntry dir = wad.findlump("COLORMAP");
-    dir.seek(0, SEEK_SET);
-    dir.read(colormap, 256 * 34);
-
-    glGenTextures(1, &g.colormap_texture);
-    glBindTexture(GL_TEXTURE_2D, g.colormap_texture);
+    g.lut = buildcolorlut(wad);
+    glGenTextures(1, &g.lut_texture);
+    glBindTexture(GL_TEXTURE_2D, g.lut_texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexImage2D(
         GL_TEXTURE_2D,
         0,
-        GL_R8UI,
-        256, 34,
+        GL_RGBA8,
+        ColorLUT::WIDTH, ColorLUT::HEIGHT,
         0,
-        GL_RED_INTEGER,
+        GL_RGBA,
         GL_UNSIGNED_BYTE,
-        colormap);
-    delete[] colormap;
+        g.lut.rgba.data());
 
 
     /* make GLTextures from the textures */
@@ -1123,42 +1219,115 @@ int main(int argc, char *argv[])
         auto &name = pair.first;
         auto &tex = pair.second;
 
-        auto imgdata = new uint32_t[tex.data.size()];
-        for (size_t i = 0; i < tex.data.size(); ++i)
-        {
-            imgdata[i] =\
-                ((tex.opaque[i]? 0xFF : 0) << 8)
-                | tex.data[i];
-        }
         g.textures.emplace(
             tolowercase(name),
-            new GLTexture{tex.width, tex.height, imgdata});
-        delete[] imgdata;
+            new GLTexture{tex.width, tex.height, tex.pixels.data()});
     }
 
-    /* make GLTextures from the flats */
+    /* make GLTextures from the flats
+     * (one per distinct flat, see WAD::flats) */
+    std::unordered_map<void const *, std::shared_ptr<GLTexture>> uploaded{};
     for (auto &pair : wad.flats)
     {
         auto &name = pair.first;
         auto &flat = pair.second;
 
-        auto imgdata = new uint32_t[flat.size()];
-        for (size_t i = 0; i < flat.size(); ++i)
+        auto &tex = uploaded[flat.get()];
+        if (tex == nullptr)
         {
-            imgdata[i] = 0xFF00 | flat[i];
+            tex.reset(new GLTexture{64, 64, flat->data()});
+        }
+        g.flats.emplace(name, tex);
+    }
+
+    /* pack the textures and flats into the atlas, tallest first
+     * (anything too big for a layer is only drawn on its own) */
+    {
+        struct Image
+        {
+            std::string name;
+            bool flat;
+            size_t width, height;
+            IndexedPixel const *pixels;
+        };
+        std::vector<Image> images{};
+        for (auto &pair : wad.textures)
+        {
+            auto &tex = pair.second;
+            images.push_back({
+                tolowercase(pair.first),
+                false,
+                tex.width, tex.height,
+                tex.pixels.data()});
+        }
+        for (auto &pair : wad.flats)
+        {
+            images.push_back({pair.first, true, 64, 64, pair.second->data()});
+        }
+        std::sort(
+            images.begin(), images.end(),
+            [](Image const &a, Image const &b)
+            {
+                return std::tie(b.height, b.width, a.name)
+                     < std::tie(a.height, a.width, b.name);
+            });
+
+        /* shared flats are only packed once */
+        auto &atlas = g.atlas_images;
+        std::unordered_map<IndexedPixel const *, Atlas::Rect> packed{};
+        for (auto &image : images)
+        {
+            try
+            {
+                auto it = packed.find(image.pixels);
+                if (it == packed.end())
+                {
+                    it = packed.emplace(
+                        image.pixels,
+                        atlas.add(image.width, image.height, image.pixels))
+                        .first;
+                }
+                (image.flat? g.atlas_flats : g.atlas_textures).emplace(
+                    image.name,
+                    it->second);
+            }
+            catch (std::length_error &e)
+            {
+            }
+        }
+
+        std::vector<void const *> layers{};
+        for (size_t i = 0; i < atlas.layers(); ++i)
+        {
+            layers.push_back(atlas.layer(i));
+        }
+        if (!layers.empty())
+        {
+            g.atlas.reset(
+                new GLTextureArray{atlas.size(), atlas.size(), layers});
+        }
+        if (verbose)
+        {
+            printf(
+                "atlas: %lu images in %lu layers\n",
+                packed.size(),
+                atlas.layers());
         }
-        g.flats.emplace(
-            name,
-            new GLTexture{64, 64, imgdata});
-        delete[] imgdata;
     }
 
     /* make GLTextures from the sprites */
+    uploaded.clear();
     for (auto &pair : wad.sprites)
     {
         auto &name = pair.first;
         auto &sprite = pair.second;
-        g.sprites.emplace(name, picture2gltexture(sprite));
+
+        auto &tex = uploaded[sprite.get()];
+        if (tex == nullptr)
+        {
+            tex.reset(picture2gltexture(sprite->rasterize()));
+        }
+        g.sprites.emplace(name, tex);
     }
 
     /* load the GUI pictures */
@@ -1212,6 +1381,11 @@ int main(int argc, char *argv[])
 
     /* load the first level */
     gs.setlevel(1);
+    gs.waitforlevel();
+    if (gs.renderlevel == nullptr)
+    {
+        exit(EXIT_FAILURE);
+    }
 
 
     /* FPS timer */
@@ -1222,6 +1396,8 @@ int main(int argc, char *argv[])
     float const speed = 256;
     float const turnspeed = 256;
     Uint64 const freq = SDL_GetPerformanceFrequency();
+    /* meshes uploaded per frame while a new level's coming in */
+    size_t const upload_budget = 64;
 
     SDL_Event e;
     while (gs.state != State::Exit)
@@ -1332,6 +1508,9 @@ int main(int argc, char *argv[])
             }
         }
 
+        /* carry on loading the next level, if there is one */
+        gs.updatelevel(upload_budget);
+
         /* update the game */
         Uint64 now = SDL_GetPerformanceCounter();
         if (gs.state == State::InLevel && !gs.menu_open)
@@ -1356,7 +1535,7 @@ int main(int argc, char *argv[])
             try
             {
                 ssector =\
-                    get_ssector(-g.cam.pos.x, g.cam.pos.z, gs.level);
+                    get_ssector(-g.cam.pos.x, g.cam.pos.z, *gs.level);
             }
             catch (std::runtime_error &e)
             {
@@ -1364,12 +1543,9 @@ int main(int argc, char *argv[])
             if (ssector != -1)
             {
                 auto &seg =\
-                    gs.level.segs[gs.level.ssectors[ssector].start];
-                auto &ld = gs.level.linedefs[seg.linedef];
-                g.cam.pos.y = (
-                    seg.direction?
-                        ld.left
-                        : ld.right)->sector->floor + 48;
+                    gs.level->segs[gs.level->ssectors[ssector].start];
+                g.cam.pos.y =\
+                    gs.level->sector(*gs.level->front(seg)).floor + 48;
             }
 
             /* update the GUI numbers */
@@ -1477,7 +1653,7 @@ int main(int argc, char *argv[])
             for (auto &thing : gs.renderlevel->things)
             {
                 if (   thing.framecount != -1
-                    && !thing.sprites.empty())
+                    && thing.frames != nullptr)
                 {
                     if (thing.cleanloop)
                     {
@@ -1532,9 +1708,8 @@ int main(int argc, char *argv[])
 
             glDisable(GL_DEPTH_TEST);
             guiprog.use();
-            guiprog.set("palettes", 0);
+            guiprog.set("lut", 0);
             guiprog.set("palette_idx", 0);
-            guiprog.set("colormap", 2);
             guiprog.set("colormap_idx", 0);
             guiprog.set("tex", 1);
             guiprog.set("position",
@@ -1572,9 +1747,7 @@ int main(int argc, char *argv[])
             glDisable(GL_DEPTH_TEST);
 
             glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, g.palette_texture);
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, g.colormap_texture);
+            glBindTexture(GL_TEXTURE_2D, g.lut_texture);
             glActiveTexture(GL_TEXTURE1);
 
             auto &img = g.menu_images["TITLEPIC"];
@@ -1592,9 +1765,8 @@ int main(int argc, char *argv[])
             double const h = img->height / aspect_h;
 
             guiprog.use();
-            guiprog.set("palettes", 0);
+            guiprog.set("lut", 0);
             guiprog.set("palette_idx", 0);
-            guiprog.set("colormap", 2);
             guiprog.set("colormap_idx", 0);
             guiprog.set("tex", 1);
             guiprog.set("position",
@@ -1662,7 +1834,7 @@ int main(int argc, char *argv[])
     /* TODO: switch from using raw ANSI escapes
      * to something more cross-platform */
     DirEntry exittext = wad.findlump("ENDOOM");
-    auto textdata = exittext.data.get();
+    auto textdata = exittext.bytes();
     for (size_t y = 0; y < 25; ++y)
     {
         for (size_t x = 0; x < 80; ++x)
@@ -1688,6 +1860,8 @@ int main(int argc, char *argv[])
     printf("\x1b[0m");
 
     /* cleanup */
+    /* a level might still be loading into the WAD */
+    gs.loader.wait();
     SDL_RemoveTimer(timer1hz);
     SDL_RemoveTimer(timer35hz);
 
@@ -1704,6 +1878,12 @@ int main(int argc, char *argv[])
     printf("Average FPS: %g\n",
         (double)frames_cumulative / (double)seconds_count);
 
+    /* remember any textures that were composited this time */
+    if (!assets_cached || wad.textures.size() != cached_textures)
+    {
+        saveassetcache(assets, wad);
+    }
+
     return EXIT_SUCCESS;
 }
 
@@ -1711,14 +1891,7 @@ int main(int argc, char *argv[])
 
 GLTexture *picture2gltexture(Picture const &p)
 {
-    auto data = new uint32_t[p.data.size()];
-    for (size_t i = 0; i < p.data.size(); ++i)
-    {
-        data[i] = ((p.opaque[i]? 0xFF : 0) << 8) | p.data[i];
-    }
-    auto gltexture = new GLTexture{p.width, p.height, data};
-    delete[] data;
-    return gltexture;
+    return new GLTexture{p.width, p.height, p.pixels.data()};
 }
 
 /* true iff (x,y) is on the right side of n's partition line */
@@ -2015,8 +2188,8 @@ void handle_event_InLevel(GameState &gs, SDL_Event e)
 
             case SDLK_SPACE:
                 gs.setlevel(
-                    gs.level_idx
-                    + (gs.level_idx % 10 == 9)
+                    gs.wanted_idx
+                    + (gs.wanted_idx % 10 == 9)
                     + 1);
                 break;
             }
@@ -2031,17 +2204,14 @@ void render_level(RenderLevel const &lvl, RenderGlobals const &g)
 {
     /* draw the floors and ceilings */
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g.palette_texture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, g.colormap_texture);
+    glBindTexture(GL_TEXTURE_2D, g.lut_texture);
     glActiveTexture(GL_TEXTURE1);
 
     g.program->use();
     g.program->set("camera", g.cam.matrix());
     g.program->set("projection", g.projection);
-    g.program->set("palettes", 0);
-    g.program->set("palette", g.palette_number);
-    g.program->set("colormap", 2);
+    g.program->set("lut", 0);
+    g.program->set("palette_idx", g.palette_number);
     g.program->set("tex", 1);
 
     for (auto &floor : lvl.floors)
@@ -2079,37 +2249,54 @@ void render_level(RenderLevel const &lvl, RenderGlobals const &g)
     /* draw the walls */
     render_node(lvl.raw->nodes.size() - 1, lvl, g);
 
+    /* draw everything that's in the atlas */
+    if (lvl.batch != nullptr && g.atlas != nullptr)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, g.lut_texture);
+        glActiveTexture(GL_TEXTURE1);
+        g.atlas->bind();
+
+        g.atlas_program->use();
+        g.atlas_program->set("camera", g.cam.matrix());
+        g.atlas_program->set("projection", g.projection);
+        g.atlas_program->set("lut", 0);
+        g.atlas_program->set("palette_idx", g.palette_number);
+        g.atlas_program->set("atlas", 1);
+
+        lvl.batch->bind();
+        glDrawElements(
+            GL_TRIANGLES,
+            lvl.batch->size(),
+            GL_UNSIGNED_INT,
+            0);
+    }
+
     /* draw the things */
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g.palette_texture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, g.colormap_texture);
+    glBindTexture(GL_TEXTURE_2D, g.lut_texture);
     glActiveTexture(GL_TEXTURE1);
 
     g.billboard_shader->use();
     g.billboard_shader->set("camera", g.cam.matrix());
     g.billboard_shader->set("projection", g.projection);
-    g.billboard_shader->set("palettes", 0);
-    g.billboard_shader->set("palette", g.palette_number);
-    g.billboard_shader->set("colormap", 2);
+    g.billboard_shader->set("lut", 0);
+    g.billboard_shader->set("palette_idx", g.palette_number);
     g.billboard_shader->set("tex", 1);
 
     thingquad->bind();
 
     for (auto &t : lvl.things)
     {
-        if (!t.sprites.empty())
+        if (   t.frames != nullptr
+            && (size_t)t.frame_idx < t.frames->size())
         {
             g.billboard_shader->set("colormap_idx",
-                (255 - t.sector->lightlevel) / 8);
-
-            std::string sprname = "";
+                (255 - lvl.raw->sectors[t.sector].lightlevel) / 8);
 
+            size_t rotation = 0;
             if (t.angled)
             {
-                char frame = 'A' + t.frame_idx;
-                char angle = '1';
-
                 double a =\
                     glm::degrees(
                         atan2(
@@ -2119,18 +2306,17 @@ void render_level(RenderLevel const &lvl, RenderGlobals const &g)
                 {
                     a = 360.0 + a;
                 }
-                int ang = fmod(a + t.angle + 22.5, 360.0) / 45;
-                angle = '1' + (char)ang;
-
-                sprname = std::string{frame} + std::string{angle};
+                /* things can face a negative angle, so this wraps
+                 * into 0-7 whichever way round it's gone */
+                int const octant = floor((a + t.angle + 22.5) / 45.0);
+                rotation = ((octant % 8) + 8) % 8;
             }
-            else
+
+            auto &spr = (*t.frames)[t.frame_idx][rotation];
+            if (spr.tex == nullptr)
             {
-                char frame = 'A' + t.frame_idx;
-                sprname = std::string{frame} + "0";
+                continue;
             }
-
-            auto &spr = t.sprites.at(sprname);
             auto scale =\
                 glm::scale(
                     glm::mat4{1},
@@ -2191,24 +2377,20 @@ void render_ssector(
     RenderGlobals const &g)
 {
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g.palette_texture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, g.colormap_texture);
+    glBindTexture(GL_TEXTURE_2D, g.lut_texture);
     glActiveTexture(GL_TEXTURE1);
 
     auto &ssector = lvl.raw->ssectors[index];
     auto &seg = lvl.raw->segs[ssector.start];
-    auto &ld = lvl.raw->linedefs[seg.linedef];
-    auto &side = seg.direction? ld.left : ld.right;
+    auto side = lvl.raw->front(seg);
 
     g.program->use();
     g.program->set("camera", g.cam.matrix());
     g.program->set("projection", g.projection);
-    g.program->set("palettes", 0);
-    g.program->set("palette", g.palette_number);
-    g.program->set("colormap", 2);
+    g.program->set("lut", 0);
+    g.program->set("palette_idx", g.palette_number);
     g.program->set("colormap_idx",
-        (255 - side->sector->lightlevel) / 8);
+        (255 - lvl.raw->sector(*side).lightlevel) / 8);
     g.program->set("tex", 1);
 
     for (size_t i = 0; i < ssector.count; ++i)
@@ -2277,15 +2459,12 @@ void render_hud(
     RenderGlobals &g)
 {
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g.palette_texture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, g.colormap_texture);
+    glBindTexture(GL_TEXTURE_2D, g.lut_texture);
     glActiveTexture(GL_TEXTURE1);
 
     guiprog.use();
-    guiprog.set("palettes", 0);
+    guiprog.set("lut", 0);
     guiprog.set("palette_idx", 0);
-    guiprog.set("colormap", 2);
     guiprog.set("colormap_idx", 0);
     guiprog.set("tex", 1);
     guiquad.bind();
@@ -2301,7 +2480,7 @@ void render_hud(
         sprname = hands[doomguy.weapon] + "2A0";
     }
     auto &img = g.sprites[sprname];
-    auto &spr = wad.sprites[sprname];
+    auto &spr = *wad.sprites[sprname];
 
     double const w = img->width / aspect_w;
     double const h = img->height / aspect_h;
@@ -2363,15 +2542,12 @@ void render_menu(
     RenderGlobals &g)
 {
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g.palette_texture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, g.colormap_texture);
+    glBindTexture(GL_TEXTURE_2D, g.lut_texture);
     glActiveTexture(GL_TEXTURE1);
 
     guiprog.use();
-    guiprog.set("palettes", 0);
+    guiprog.set("lut", 0);
     guiprog.set("palette_idx", 0);
-    guiprog.set("colormap", 2);
     guiprog.set("colormap_idx", 0);
     guiprog.set("tex", 1);
     guiquad.bind();
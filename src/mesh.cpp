@@ -85,3 +85,67 @@ Mesh::~Mesh()
     glDeleteVertexArrays(1, &_vao);
 }
 
+
+
+GLsizei AtlasMesh::size(void) const
+{
+    return _size;
+}
+
+void AtlasMesh::bind(void) const
+{
+    glBindVertexArray(_vao);
+}
+
+
+
+AtlasMesh::AtlasMesh(
+  std::vector<AtlasMesh::Vertex> const &vertices,
+  std::vector<GLuint> const &indices)
+:   _vao{0},
+    _vbo{0},
+    _ebo{0},
+    _size{(GLsizei)indices.size()}
+{
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vbo);
+    glGenBuffers(1, &_ebo);
+
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+
+    glBufferData(
+        GL_ARRAY_BUFFER,
+        vertices.size() * sizeof(AtlasMesh::Vertex),
+        vertices.data(),
+        GL_STATIC_DRAW);
+    glBufferData(
+        GL_ELEMENT_ARRAY_BUFFER,
+        indices.size() * sizeof(GLuint),
+        indices.data(),
+        GL_STATIC_DRAW);
+
+    /* position, texture coordinate, rect, layer, colormap */
+    GLint const sizes[] = {3, 2, 4, 1, 1};
+    size_t offset = 0;
+    for (GLuint i = 0; i < 5; ++i)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(
+            i,
+            sizes[i],
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(AtlasMesh::Vertex),
+            (void *)(sizeof(GLfloat) * offset));
+        offset += sizes[i];
+    }
+}
+
+AtlasMesh::~AtlasMesh()
+{
+    glDeleteBuffers(1, &_ebo);
+    glDeleteBuffers(1, &_vbo);
+    glDeleteVertexArrays(1, &_vao);
+}
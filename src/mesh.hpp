@@ -49,5 +49,47 @@ private:
 };
 
 
+/* a Mesh drawn from the texture atlas, where every vertex says which
+ * image it uses, so a whole level can be drawn at once
+ * (see shaders/atlas.glvs for the attributes) */
+class AtlasMesh
+{
+public:
+
+    struct Vertex
+    {
+        GLfloat x, y, z;
+        /* in texels, wrapped into 'rect' by the shader */
+        GLfloat s, t;
+        /* x, y, width, height of the image in its layer */
+        GLfloat rect[4];
+        GLfloat layer;
+        /* row of the COLORMAP to use */
+        GLfloat colormap;
+    };
+
+
+    /* get the number of vertices */
+    GLsizei size(void) const;
+
+    /* bind the mesh's VAO */
+    void bind(void) const;
+
+
+    AtlasMesh(
+        std::vector<AtlasMesh::Vertex> const &vertices,
+        std::vector<GLuint> const &indices);
+    ~AtlasMesh();
+
+
+private:
+    GLuint _vao, _vbo, _ebo;
+    GLsizei _size;
+
+    AtlasMesh const &operator=(AtlasMesh const &other) = delete;
+    AtlasMesh(AtlasMesh const &other) = delete;
+};
+
+
 #endif
 
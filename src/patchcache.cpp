@@ -0,0 +1,111 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "patchcache.hpp"
+#include "readwad.hpp"
+
+
+
+PatchCache::PatchCache(size_t budget)
+:   _lock{},
+    _slots{},
+    _lru{},
+    _bytes{0},
+    _budget{budget},
+    _hits{0},
+    _misses{0},
+    _evictions{0}
+{
+}
+
+std::shared_ptr<Picture const> PatchCache::get(
+    WAD const &wad,
+    uint16_t pname_index)
+{
+    std::promise<std::shared_ptr<Picture const>> promise{};
+
+    std::unique_lock<std::mutex> lock{_lock};
+    auto it = _slots.find(pname_index);
+    if (it != _slots.end())
+    {
+        _hits++;
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+        auto picture = it->second.picture;
+        /* don't hold the lock while waiting on someone else's decode */
+        lock.unlock();
+        return picture.get();
+    }
+
+    _misses++;
+    _lru.push_front(pname_index);
+    _slots[pname_index] = Slot{
+        promise.get_future().share(),
+        0,
+        _lru.begin()};
+    lock.unlock();
+
+    /* decode it ourselves */
+    std::shared_ptr<Picture const> picture{};
+    try
+    {
+        DirEntry lump = wad.directory.at(wad.pnames.at(pname_index));
+        picture = std::make_shared<Picture const>(loadpicture(lump));
+    }
+    catch (...)
+    {
+        /* let the waiters see the error, but don't cache it */
+        promise.set_exception(std::current_exception());
+        lock.lock();
+        auto it = _slots.find(pname_index);
+        _lru.erase(it->second.lru);
+        _slots.erase(it);
+        throw;
+    }
+    promise.set_value(picture);
+
+    lock.lock();
+    auto &slot = _slots.at(pname_index);
+    slot.bytes =\
+        sizeof(Picture)
+        + picture->pixels.size() * sizeof(IndexedPixel);
+    _bytes += slot.bytes;
+    _shrink();
+
+    return picture;
+}
+
+PatchCache::Stats PatchCache::stats(void) const
+{
+    std::lock_guard<std::mutex> guard{_lock};
+    return Stats{_hits, _misses, _evictions, _bytes};
+}
+
+void PatchCache::budget(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard{_lock};
+    _budget = bytes;
+    _shrink();
+}
+
+
+
+void PatchCache::_shrink(void)
+{
+    /* walk from the least recently used end, skipping
+     * patches which are still being decoded */
+    auto it = _lru.end();
+    while (_budget != 0 && _bytes > _budget && it != _lru.begin())
+    {
+        --it;
+        auto &slot = _slots.at(*it);
+        if (slot.bytes == 0)
+        {
+            continue;
+        }
+        _bytes -= slot.bytes;
+        _evictions++;
+        _slots.erase(*it);
+        it = _lru.erase(it);
+    }
+}
@@ -0,0 +1,75 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _PATCHCACHE_H
+#define _PATCHCACHE_H
+
+#include "wad.hpp"
+
+#include <atomic>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+
+/* decoded patches, keyed by PNAMES index
+ * (safe to share between threads. Each patch is decoded once, by
+ *  whoever asks for it first; anyone else asking at the same time
+ *  waits for that decode instead of doing their own) */
+class PatchCache
+{
+public:
+    struct Stats
+    {
+        size_t hits, misses, evictions;
+        /* bytes of decoded patches currently held */
+        size_t bytes;
+    };
+
+    /* get a patch, decoding it if it isn't cached */
+    std::shared_ptr<Picture const> get(
+        WAD const &wad,
+        uint16_t pname_index);
+
+    /* hit/miss counters */
+    Stats stats(void) const;
+
+    /* set the byte budget (0 = unlimited) */
+    void budget(size_t bytes);
+
+
+    PatchCache(size_t budget=32 * 1024 * 1024);
+
+private:
+    struct Slot
+    {
+        std::shared_future<std::shared_ptr<Picture const>> picture;
+        /* 0 until the decode is finished */
+        size_t bytes;
+        std::list<uint16_t>::iterator lru;
+    };
+
+    mutable std::mutex _lock;
+    std::unordered_map<uint16_t, Slot> _slots;
+    /* most recently used at the front */
+    std::list<uint16_t> _lru;
+    size_t _bytes, _budget;
+
+    std::atomic<size_t> _hits, _misses, _evictions;
+
+    /* evict finished patches until we're under budget
+     * (the caller must hold _lock) */
+    void _shrink(void);
+
+
+    /* no copying allowed! */
+    PatchCache &operator=(PatchCache const &other) = delete;
+    PatchCache(PatchCache const &other) = delete;
+};
+
+
+#endif
@@ -2,15 +2,26 @@
  * See LICENSE file for copyright and license details.
  */
 
+#include "patchcache.hpp"
 #include "readwad.hpp"
+#include "threadpool.hpp"
 #include "things.hpp"
 #include "wad.hpp"
+#include "wadfile.hpp"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 
 /* FIXME: TEMP */
@@ -18,18 +29,27 @@
 //#define wad_DO_TEXTURE_PGMS
 
 
+bool verbose = false;
 
-WAD loadIWAD(FILE *f)
+
+/* read a .WAD's directory
+ * (lump bodies are left in the mapped file until they're used) */
+static std::vector<DirEntry> readdirectory(
+    std::shared_ptr<WADFile> const &file,
+    char const *type,
+    uint16_t source)
 {
-    WAD wad{};
+    uint8_t const *header = file->data();
 
     char id[5] = {0};
-    fread(id, 1, 4, f);
+    memcpy(id, header, 4);
 
-    if (strcmp(id, "IWAD") != 0)
+    if (strcmp(id, type) != 0)
     {
         throw std::runtime_error(
-            "Bad IWAD id '"
+            "Bad "
+            + std::string{type}
+            + " id '"
             + std::string{id}
             + "')");
     }
@@ -38,152 +58,294 @@ WAD loadIWAD(FILE *f)
     uint32_t lump_count = 0,
              directory_pointer = 0;
 
-    fread(&lump_count, 4, 1, f);
-    fread(&directory_pointer, 4, 1, f);
+    memcpy(&lump_count, header + 4, 4);
+    memcpy(&directory_pointer, header + 8, 4);
+
+    if (   directory_pointer > file->size()
+        || lump_count > (file->size() - directory_pointer) / 16)
+    {
+        throw std::runtime_error(
+            "Bad "
+            + std::string{type}
+            + " directory ("
+            + std::to_string(lump_count)
+            + " lumps @ "
+            + std::to_string(directory_pointer)
+            + ")");
+    }
+
+    std::vector<DirEntry> directory{};
+    directory.reserve(lump_count);
 
-    fseek(f, directory_pointer, SEEK_SET);
-    for (uint32_t i = 0; i <= lump_count; ++i)
+    uint8_t const *dirptr = header + directory_pointer;
+    for (uint32_t i = 0; i < lump_count; ++i, dirptr += 16)
     {
         DirEntry entry{};
         uint32_t offset = 0;
 
-        fread(&offset, 4, 1, f);
-        fread(&entry.size, 4, 1, f);
-        fread(&entry.name, 8, 1, f);
+        memcpy(&offset, dirptr + 0, 4);
+        memcpy(&entry.size, dirptr + 4, 4);
+        memcpy(&entry.name, dirptr + 8, 8);
         entry.name[8] = '\0';
 
-        auto data = new uint8_t[entry.size];
-        fseek(f, offset, SEEK_SET);
-        fread(data, 1, entry.size, f);
-        fseek(f, directory_pointer + (16 * i), SEEK_SET);
-        entry.data.reset(data);
+        if (offset > file->size() || entry.size > file->size() - offset)
+        {
+            throw std::runtime_error(
+                "Bad "
+                + std::string{type}
+                + " lump '"
+                + std::string{entry.name}
+                + "' ("
+                + std::to_string(entry.size)
+                + " bytes @ "
+                + std::to_string(offset)
+                + ")");
+        }
+        entry.file = file;
+        entry.filepos = offset;
+        entry.source = source;
 
-        wad.directory.push_back(entry);
+        directory.push_back(entry);
     }
+
+    /* namespaces have to be worked out per file, before merging
+     * moves the lumps away from their markers */
+    classifynamespaces(directory);
+    return directory;
+}
+
+
+
+WAD loadIWAD(FILE *f, std::string const &name)
+{
+    WAD wad{};
+    wad.directory = readdirectory(
+        std::make_shared<WADFile>(f),
+        "IWAD",
+        0);
+    wad.sources = {name};
+    wad.reindex();
     return wad;
 }
 
-void patchWAD(WAD &wad, FILE *f)
+void patchWAD(WAD &wad, FILE *f, std::string const &name)
 {
-    char id[5] = {0};
-    fread(id, 1, 4, f);
+    patchWADs(wad, {{name, f}});
+}
 
-    if (strcmp(id, "PWAD") != 0)
+void patchWADs(
+    WAD &wad,
+    std::vector<std::pair<std::string, FILE *>> const &pwads)
+{
+    if (wad.sources.size() + pwads.size() > UINT16_MAX)
     {
-        throw std::runtime_error(
-            "Bad PWAD id '"
-            + std::string{id}
-            + "')");
+        throw std::runtime_error("Too many PWADs");
     }
 
-    /* read the directory */
-    uint32_t lump_count = 0,
-             directory_pointer = 0;
+    /* read all the directories up front, so the WAD's directory only
+     * has to grow once */
+    std::vector<std::vector<DirEntry>> directories{};
+    size_t total = wad.directory.size();
+    for (auto &pwad : pwads)
+    {
+        directories.push_back(
+            readdirectory(
+                std::make_shared<WADFile>(pwad.second),
+                "PWAD",
+                wad.sources.size() + directories.size()));
+        total += directories.back().size();
+    }
+    wad.directory.reserve(total);
 
-    fread(&lump_count, 4, 1, f);
-    fread(&directory_pointer, 4, 1, f);
+    for (size_t i = 0; i < pwads.size(); ++i)
+    {
+        wad.sources.push_back(pwads[i].first);
 
-    size_t level = 0;
+        auto stats = wad.merge(std::move(directories[i]));
+        printf("patch: %s (%lu replaced, %lu added)\n",
+            pwads[i].first.c_str(),
+            stats.replaced,
+            stats.added);
+    }
+}
 
-    fseek(f, directory_pointer, SEEK_SET);
-    for (uint32_t i = 0; i <= lump_count; ++i)
+void printsources(WAD const &wad, FILE *out)
+{
+    for (size_t i = 0; i < wad.directory.size(); ++i)
     {
-        DirEntry entry{};
-        uint32_t offset = 0;
+        auto &entry = wad.directory[i];
+        if (entry.source != 0)
+        {
+            fprintf(out, "%6lu %-8s %s\n",
+                i,
+                entry.name,
+                wad.sources[entry.source].c_str());
+        }
+    }
+}
 
-        fread(&offset, 4, 1, f);
-        fread(&entry.size, 4, 1, f);
-        fread(&entry.name, 8, 1, f);
-        entry.name[8] = '\0';
+/* decode every one of 'lumps' with decode(DirEntry &), in parallel
+ * (lumps with identical bodies are only decoded once, and share
+ *  the result) */
+template<typename T, typename F>
+static std::vector<std::shared_ptr<T const>> _decodeshared(
+    WAD &wad,
+    std::vector<size_t> const &lumps,
+    F decode)
+{
+    auto &pool = ThreadPool::global();
 
-        auto data = new uint8_t[entry.size];
-        fseek(f, offset, SEEK_SET);
-        fread(data, 1, entry.size, f);
-        fseek(f, directory_pointer + (16 * i), SEEK_SET);
-        entry.data.reset(data);
-
-        /* if this lump is a level marker,
-         * set the directory search offset to here */
-        if (   (   entry.name[4] == '\0'
-                && entry.name[0] == 'E'
-                && entry.name[2] == 'M'
-                && isdigit(entry.name[1])
-                && isdigit(entry.name[3]))
-            || (   entry.name[5] == '\0'
-                && strncmp("MAP", entry.name, 3) == 0
-                && isdigit(entry.name[3])
-                && isdigit(entry.name[4])))
-        {
-            try
-            {
-                level = wad.lumpidx(entry.name);
-            }
-            catch (std::out_of_range &e)
+    std::vector<size_t> hashes(lumps.size());
+    pool.parallel_for(
+        lumps.size(),
+        [&wad, &lumps, &hashes](size_t i)
+        {
+            DirEntry lump = wad.directory[lumps[i]];
+            hashes[i] = std::hash<std::string_view>{}(
+                std::string_view{
+                    reinterpret_cast<char const *>(lump.bytes()),
+                    lump.size});
+        });
+
+    /* find the first lump with each body */
+    std::vector<size_t> first(lumps.size()),
+                        unique{};
+    std::unordered_multimap<size_t, size_t> seen{};
+    for (size_t i = 0; i < lumps.size(); ++i)
+    {
+        first[i] = i;
+
+        DirEntry lump = wad.directory[lumps[i]];
+        auto range = seen.equal_range(hashes[i]);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            DirEntry other = wad.directory[lumps[it->second]];
+            if (   other.size == lump.size
+                && memcmp(other.bytes(), lump.bytes(), lump.size) == 0)
             {
-                wad.directory.push_back(entry);
-                level = wad.directory.size() - 1;
+                first[i] = it->second;
+                break;
             }
         }
+        if (first[i] == i)
+        {
+            seen.emplace(hashes[i], i);
+            unique.push_back(i);
+        }
+    }
+
+    std::vector<std::shared_ptr<T const>> out(lumps.size());
+    pool.parallel_for(
+        unique.size(),
+        [&wad, &lumps, &unique, &out, &decode](size_t i)
+        {
+            DirEntry lump = wad.directory[lumps[unique[i]]];
+            out[unique[i]] = std::make_shared<T const>(decode(lump));
+        });
+    for (size_t i = 0; i < lumps.size(); ++i)
+    {
+        out[i] = out[first[i]];
+    }
+    return out;
+}
+
+
+void buildspriteframes(WAD &wad)
+{
+    /* frame letters go up to ']' in the IWADs, and rotations to 8 */
+    static size_t const MAX_FRAMES = 29;
+
+    wad.spriteframes.clear();
+
+    auto install = [&wad](
+        std::string const &lump,
+        char frame,
+        char rotation,
+        bool flipx)
+    {
+        if (   frame < 'A' || frame >= (char)('A' + MAX_FRAMES)
+            || rotation < '0' || rotation > '8')
+        {
+            return;
+        }
+
+        auto &frames = wad.spriteframes[lump.substr(0, 4)];
+        size_t const idx = frame - 'A';
+        if (frames.size() <= idx)
+        {
+            frames.resize(idx + 1, SpriteFrame{false, {}});
+        }
+
+        /* later lumps replace earlier ones, so a PWAD can replace
+         * one view of a frame without replacing the rest */
+        auto &sf = frames[idx];
+        SpriteFrame::View const view{lump, flipx};
+        if (rotation == '0')
+        {
+            sf.rotated = false;
+            sf.views.fill(view);
+        }
         else
         {
-            try
-            {
-                /* if this lump is a level lump, add it to the level */
-                if (   strcmp(entry.name, "THINGS") == 0
-                    || strcmp(entry.name, "LINEDEFS") == 0
-                    || strcmp(entry.name, "SIDEDEFS") == 0
-                    || strcmp(entry.name, "VERTEXES") == 0
-                    || strcmp(entry.name, "SEGS") == 0
-                    || strcmp(entry.name, "SSECTORS") == 0
-                    || strcmp(entry.name, "NODES") == 0
-                    || strcmp(entry.name, "SECTORS") == 0
-                    || strcmp(entry.name, "REJECT") == 0
-                    || strcmp(entry.name, "BLOCKMAP") == 0)
-                {
-                    wad.directory[wad.lumpidx(entry.name, level)] =\
-                        entry;
-                }
-                else
-                {
-                    wad.directory[wad.lumpidx(entry.name)] = entry;
-                }
-            }
-            catch (std::out_of_range &e)
-            {
-                wad.directory.push_back(entry);
-            }
+            sf.rotated = true;
+            sf.views[rotation - '1'] = view;
+        }
+    };
+
+    /* go in directory order, so which lump wins doesn't depend on
+     * the order of wad.sprites */
+    for (auto i : wad.nslumps(NS_SPRITES))
+    {
+        std::string const name{wad.directory[i].name};
+        if (wad.sprites.count(name) == 0 || name.size() < 6)
+        {
+            continue;
+        }
+
+        /* see SpriteFrame::View for which way round flipx goes */
+        install(name, name[4], name[5], name[5] != '0');
+        if (name.size() >= 8)
+        {
+            install(name, name[6], name[7], false);
         }
     }
 }
 
-void readwad(WAD &wad)
+
+void readtexturedefinitions(WAD &wad)
 {
-    /* load PNAMES */
-    DirEntry dir = wad.findlump("PNAMES");
-    dir.seek(0, SEEK_SET);
+    /* load PNAMES
+     * (patches are looked for in the patch namespace first, but
+     *  PWADs can have them anywhere) */
+    std::unordered_map<uint64_t, size_t> patches{};
+    for (auto idx : wad.nslumps(NS_PATCHES))
+    {
+        patches[lumpkey(wad.directory[idx].name)] = idx;
+    }
 
-    uint32_t count = 0;
-    dir.read(&count, 4);
+    auto pnames = wad.findlump("PNAMES").cursor();
 
+    wad.pnames.clear();
+    uint32_t count = pnames.read_u32();
     for (size_t i = 0; i < count; ++i)
     {
         char name[9];
         name[8] = '\0';
-        dir.read(name, 8);
-        wad.pnames.push_back(wad.lumpidx(name));
-    }
+        pnames.read_bytes(name, 8);
 
+        auto it = patches.find(lumpkey(name));
+        wad.pnames.push_back(
+            it != patches.end()? it->second : wad.lastidx(name));
+    }
 
-    /* load the palette */
-    dir = wad.findlump("PLAYPAL");
-    dir.seek(0, SEEK_SET);
-    for (size_t i = 0; i < wad.palettes.size(); ++i)
+    if (!wad.patches)
     {
-        dir.read(&wad.palettes[i], 768);
+        wad.patches = std::make_shared<PatchCache>();
     }
 
 
-    /* load textures */
+    /* load the texture definitions
+     * (TEXTURE2 overrides TEXTURE1, same as when they're built) */
     auto tds = readtexturedefs(wad, "TEXTURE1");
     try
     {
@@ -197,229 +359,477 @@ void readwad(WAD &wad)
     }
     for (auto &td : tds)
     {
-        wad.textures[td.name] = buildtexture(wad, td);
+        auto name = foldname(td.name);
+        if (wad.textures.find(name) == wad.textures.end())
+        {
+            wad.texturedefs[name] = td;
+        }
     }
+}
 
 
-    /* load the flats */
-    size_t f_start = wad.lumpidx("F_START"),
-           f_end = wad.lumpidx("F_END");
-    for (size_t i = f_start + 1; i < f_end; ++i)
-    {
-        DirEntry &lump = wad.directory[i];
-        if (   strcmp(lump.name, "F1_START") == 0
-            || strcmp(lump.name, "F1_END") == 0
-            || strcmp(lump.name, "F2_START") == 0
-            || strcmp(lump.name, "F2_END") == 0
-            || strcmp(lump.name, "F3_START") == 0
-            || strcmp(lump.name, "F3_END") == 0)
+void prefetchtextures(WAD &wad, std::vector<std::string> const &names)
+{
+    std::vector<TextureDefinition const *> tds{};
+    for (auto &name : names)
+    {
+        auto it = wad.texturedefs.find(foldname(name.c_str()));
+        if (it != wad.texturedefs.end())
         {
-            continue;
+            tds.push_back(&it->second);
         }
-        lump.seek(0, SEEK_SET);
-        wad.flats[lump.name] = Flat{};
-        lump.read(wad.flats[lump.name].data(), 4096);
     }
-
-
-    /* load the sprites */
-    size_t s_start = wad.lumpidx("S_START"),
-           s_end = wad.lumpidx("S_END");
-    for (size_t i = s_start + 1; i < s_end; ++i)
+    /* a name can be asked for more than once */
+    std::sort(tds.begin(), tds.end());
+    tds.erase(std::unique(tds.begin(), tds.end()), tds.end());
+
+    std::vector<Texture> textures{tds.size()};
+    ThreadPool::global().parallel_for(
+        tds.size(),
+        [&wad, &tds, &textures](size_t i)
+        {
+            textures[i] = buildtexture(wad, *tds[i]);
+        });
+    for (size_t i = 0; i < tds.size(); ++i)
     {
-        DirEntry &lump = wad.directory[i];
-        wad.sprites[lump.name] = loadpicture(lump);
+        auto name = foldname(tds[i]->name);
+        wad.textures[name] = std::move(textures[i]);
+        wad.texturedefs.erase(name);
     }
 }
 
-
-
-Level readlevel(std::string level, WAD &wad)
+Texture const *gettexture(WAD &wad, std::string const &texture)
 {
-    Level out{};
-    out.wad = &wad;
-    auto const lvlidx = wad.lumpidx(level.c_str());
-
-    /* read THINGS */
-    DirEntry dir = wad.findlump("THINGS", lvlidx);
-    dir.seek(0, SEEK_SET);
-
-    for (size_t i = 0; i < dir.size / 10; ++i)
+    auto name = foldname(texture.c_str());
+    auto it = wad.textures.find(name);
+    if (it == wad.textures.end())
     {
-        Thing thing{};
-
-        dir.read(&thing.x, 2);
-        dir.read(&thing.y, 2);
-        dir.read(&thing.angle, 2);
-        dir.read(&thing.type, 2);
-        dir.read(&thing.options, 2);
+        auto td = wad.texturedefs.find(name);
+        if (td == wad.texturedefs.end())
+        {
+            return nullptr;
+        }
+        it = wad.textures.emplace(name, buildtexture(wad, td->second)).first;
+        wad.texturedefs.erase(td);
+    }
+    return &it->second;
+}
 
-        out.things.push_back(thing);
+std::vector<std::string> leveltextures(Level const &lvl)
+{
+    std::vector<std::string> names{};
+    for (auto &side : lvl.sidedefs)
+    {
+        for (auto name : {side.upper, side.lower, side.middle})
+        {
+            if (name[0] != '\0' && strcmp(name, "-") != 0)
+            {
+                names.push_back(foldname(name));
+            }
+        }
     }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return names;
+}
 
 
-    /* read VERTEXES */
-    dir = wad.findlump("VERTEXES", lvlidx);
+void readwad(WAD &wad, bool lazy)
+{
+    /* load the palette */
+    DirEntry dir = wad.findlump("PLAYPAL");
     dir.seek(0, SEEK_SET);
-    for (size_t i = 0; i < dir.size / 4; ++i)
+    for (size_t i = 0; i < wad.palettes.size(); ++i)
     {
-        Vertex vertex{};
-        dir.read(&vertex.x, 2);
-        dir.read(&vertex.y, 2);
-        out.vertices.push_back(vertex);
+        dir.read(&wad.palettes[i], 768);
     }
 
-
-    /* read SECTORS */
-    dir = wad.findlump("SECTORS", lvlidx);
+    /* load the colormaps */
+    dir = wad.findlump("COLORMAP");
     dir.seek(0, SEEK_SET);
-    for (size_t i = 0; i < dir.size / 26; ++i)
-    {
-        Sector sec{};
-        char floorname[9],
-             ceilingname[9];
-        floorname[8] = ceilingname[8] = '\0';
+    dir.read(wad.colormaps.data(), sizeof(wad.colormaps));
 
-        dir.read(&sec.floor, 2);
-        dir.read(&sec.ceiling, 2);
 
-        dir.read(&floorname, 8);
-        dir.read(&ceilingname, 8);
+    /* NOTE: textures, flats and sprites are decoded in parallel on
+     * private copies of the DirEntries, then merged in directory
+     * order so the result is the same as doing it serially */
 
-        dir.read(&sec.lightlevel, 2);
-        dir.read(&sec.special, 2);
-        dir.read(&sec.tag, 2);
+    /* load textures
+     * (if 'lazy', they're built later by gettexture/prefetchtextures) */
+    readtexturedefinitions(wad);
+    if (!lazy)
+    {
+        std::vector<std::string> names{};
+        for (auto &pair : wad.texturedefs)
+        {
+            names.push_back(pair.first);
+        }
+        prefetchtextures(wad, names);
+
+        if (verbose)
+        {
+            auto stats = wad.patches->stats();
+            auto lookups = std::max<size_t>(1, stats.hits + stats.misses);
+            printf("patch cache: %lu hits, %lu misses (%.1f%% hit rate)\n",
+                stats.hits,
+                stats.misses,
+                (100.0 * stats.hits) / lookups);
+        }
+    }
 
-        sec.floor_flat = floorname;
-        sec.ceiling_flat = ceilingname;
 
-        out.sectors.push_back(sec);
+    /* load the flats */
+    auto const &flatlumps = wad.nslumps(NS_FLATS);
+    auto flats = _decodeshared<Flat>(
+        wad,
+        flatlumps,
+        [](DirEntry &lump)
+        {
+            Flat flat;
+            auto indices = lump.cursor().take(4096);
+            for (size_t j = 0; j < 4096; ++j)
+            {
+                flat[j] = IndexedPixel{indices[j], 0xFF, {0, 0}};
+            }
+            return flat;
+        });
+    for (size_t i = 0; i < flatlumps.size(); ++i)
+    {
+        wad.flats[wad.directory[flatlumps[i]].name] = flats[i];
     }
 
 
-    /* read SIDEDEFS */
-    dir = wad.findlump("SIDEDEFS", lvlidx);
-    dir.seek(0, SEEK_SET);
+    /* load the sprites */
+    auto const &spritelumps = wad.nslumps(NS_SPRITES);
+    auto sprites = _decodeshared<PostPicture>(
+        wad,
+        spritelumps,
+        [](DirEntry &lump)
+        {
+            return loadpostpicture(lump);
+        });
+    for (size_t i = 0; i < spritelumps.size(); ++i)
+    {
+        wad.sprites[wad.directory[spritelumps[i]].name] = sprites[i];
+    }
+    buildspriteframes(wad);
 
-    for (size_t i = 0; i < dir.size / 30; ++i)
+    if (verbose)
     {
-        Sidedef sd{};
-        uint16_t sector_idx = 0;
-        char up[9],
-             low[9],
-             mid[9];
-        up[8] = low[8] = mid[8] = '\0';
+        std::unordered_set<void const *> unique{};
+        for (auto &pair : wad.flats)
+        {
+            unique.insert(pair.second.get());
+        }
+        size_t const unique_flats = unique.size();
+        for (auto &pair : wad.sprites)
+        {
+            unique.insert(pair.second.get());
+        }
+        printf("flats: %lu (%lu unique), sprites: %lu (%lu unique)\n",
+            wad.flats.size(),
+            unique_flats,
+            wad.sprites.size(),
+            unique.size() - unique_flats);
+    }
+}
 
-        dir.read(&sd.x, 2);
-        dir.read(&sd.y, 2);
-        dir.read(&up, 8);
-        dir.read(&low, 8);
-        dir.read(&mid, 8);
-        dir.read(&sector_idx, 2);
 
-        sd.upper = std::string{up},
-        sd.lower = std::string{low},
-        sd.middle = std::string{mid};
 
-        sd.sector = &out.sectors[sector_idx];
+/* read a lump of fixed-size records
+ * (the count comes from the lump size, so the output is allocated once;
+ *  'convert' decodes one record from a cursor over just that record) */
+template<typename T, typename F>
+static std::vector<T> readrecords(
+    DirEntry lump,
+    size_t record_size,
+    F convert)
+{
+    auto cursor = lump.cursor();
+    size_t const count = lump.size / record_size;
 
-        out.sidedefs.push_back(sd);
+    std::vector<T> out{};
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto record = cursor.subspan(i * record_size, record_size);
+        out.push_back(convert(record));
     }
+    return out;
+}
 
+/* read a lump whose records are laid out exactly like T
+ * (T must be made only of 16-bit integers, like the on-disk record,
+ *  so the whole lump is a single copy) */
+template<typename T>
+static std::vector<T> readpacked(DirEntry lump)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    static_assert(sizeof(T) % 2 == 0 && alignof(T) == 2, "");
 
-    /* read LINEDEFS */
-    dir = wad.findlump("LINEDEFS", lvlidx);
-    dir.seek(0, SEEK_SET);
+    auto cursor = lump.cursor();
+    size_t const count = lump.size / sizeof(T);
 
-    for (size_t i = 0; i < dir.size / 14; ++i)
+    std::vector<T> out(count);
+    memcpy(out.data(), cursor.take(count * sizeof(T)), count * sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    auto words = reinterpret_cast<uint16_t *>(out.data());
+    for (size_t i = 0; i < count * sizeof(T) / 2; ++i)
     {
-        Linedef ld{};
-        uint16_t idx = 0;
+        words[i] = (words[i] << 8) | (words[i] >> 8);
+    }
+#endif
+    return out;
+}
 
-        dir.read(&idx, 2);
-        ld.start = &out.vertices[idx];
+/* make sure a record refers to something that exists */
+static uint16_t checkindex(uint16_t idx, size_t count, char const *what)
+{
+    if (idx >= count)
+    {
+        throw std::runtime_error(
+            "Bad "
+            + std::string{what}
+            + " index ("
+            + std::to_string(idx)
+            + "/"
+            + std::to_string(count)
+            + ")");
+    }
+    return idx;
+}
 
-        dir.read(&idx, 2);
-        ld.end = &out.vertices[idx];
+/* on-disk record sizes */
+static_assert(sizeof(Thing) == 10, "THINGS records are 10 bytes");
+static_assert(sizeof(Vertex) == 4, "VERTEXES records are 4 bytes");
+static_assert(sizeof(SSector) == 4, "SSECTORS records are 4 bytes");
+static_assert(sizeof(Node) == 28, "NODES records are 28 bytes");
 
-        dir.read(&ld.flags, 2);
-        dir.read(&ld.types, 2);
-        dir.read(&ld.tag, 2);
 
-        dir.read(&idx, 2);
-        ld.right = &out.sidedefs[idx];
 
-        dir.read(&idx, 2);
-        ld.left = (idx != 0xFFFF? &out.sidedefs[idx] : nullptr);
+Level readlevel(std::string level, WAD &wad)
+{
+    using clock = std::chrono::steady_clock;
 
-        out.linedefs.push_back(ld);
-    }
+    Level out{};
+    out.wad = &wad;
+    auto const range = wad.maprange(level);
 
+    /* how long each lump took to parse */
+    std::vector<std::pair<char const *, double>> times{};
+    auto lump =\
+        [&wad, &range, &times](char const *name)
+        {
+            times.push_back({name, 0});
+            return wad.findlump(name, range.first, range.second);
+        };
+    auto start = clock::now();
+    auto lap =\
+        [&times, &start]()
+        {
+            auto now = clock::now();
+            times.back().second =\
+                std::chrono::duration<double, std::milli>(now - start)
+                .count();
+            start = now;
+        };
 
-    /* read SEGS */
-    dir = wad.findlump("SEGS", lvlidx);
-    dir.seek(0, SEEK_SET);
 
-    for (size_t i = 0; i < dir.size / 12; ++i)
-    {
-        Seg seg{};
-        uint16_t startvert = 0,
-                 endvert = 0;
+    /* read THINGS */
+    out.things = readpacked<Thing>(lump("THINGS"));
+    lap();
 
-        dir.read(&startvert, 2);
-        dir.read(&endvert, 2);
-        dir.read(&seg.angle, 2);
-        dir.read(&seg.linedef, 2);
-        dir.read(&seg.direction, 2);
-        dir.read(&seg.offset, 2);
+    /* read VERTEXES */
+    out.vertices = readpacked<Vertex>(lump("VERTEXES"));
+    lap();
 
-        seg.start = &out.vertices[startvert];
-        seg.end = &out.vertices[endvert];
+    /* read SECTORS */
+    out.sectors = readrecords<Sector>(
+        lump("SECTORS"),
+        26,
+        [](LumpCursor &record)
+        {
+            Sector sec{};
+
+            sec.floor = record.read_i16();
+            sec.ceiling = record.read_i16();
+            record.read_bytes(sec.floor_flat, 8);
+            record.read_bytes(sec.ceiling_flat, 8);
+            sec.lightlevel = record.read_u16();
+            sec.special = record.read_u16();
+            sec.tag = record.read_u16();
+            return sec;
+        });
+    lap();
 
-        out.segs.push_back(seg);
-    }
+    /* read SIDEDEFS */
+    out.sidedefs = readrecords<Sidedef>(
+        lump("SIDEDEFS"),
+        30,
+        [&out](LumpCursor &record)
+        {
+            Sidedef sd{};
+
+            sd.x = record.read_i16();
+            sd.y = record.read_i16();
+            record.read_bytes(sd.upper, 8);
+            record.read_bytes(sd.lower, 8);
+            record.read_bytes(sd.middle, 8);
+            sd.sector = checkindex(
+                record.read_u16(),
+                out.sectors.size(),
+                "SIDEDEF sector");
+            return sd;
+        });
+    lap();
 
+    /* read LINEDEFS */
+    out.linedefs = readrecords<Linedef>(
+        lump("LINEDEFS"),
+        14,
+        [&out](LumpCursor &record)
+        {
+            Linedef ld{};
+
+            ld.start = checkindex(
+                record.read_u16(),
+                out.vertices.size(),
+                "LINEDEF start");
+            ld.end = checkindex(
+                record.read_u16(),
+                out.vertices.size(),
+                "LINEDEF end");
+            ld.flags = record.read_u16();
+            ld.types = record.read_u16();
+            ld.tag = record.read_u16();
+            ld.right = checkindex(
+                record.read_u16(),
+                out.sidedefs.size(),
+                "LINEDEF right");
+
+            uint16_t idx = record.read_u16();
+            ld.left = (
+                idx == NO_SIDEDEF?
+                    NO_SIDEDEF
+                    : checkindex(idx, out.sidedefs.size(), "LINEDEF left"));
+            return ld;
+        });
+    lap();
 
-    /* read SSECTORS */
-    dir = wad.findlump("SSECTORS", lvlidx);
-    dir.seek(0, SEEK_SET);
+    /* read SEGS */
+    out.segs = readrecords<Seg>(
+        lump("SEGS"),
+        12,
+        [&out](LumpCursor &record)
+        {
+            Seg seg{};
+
+            seg.start = checkindex(
+                record.read_u16(),
+                out.vertices.size(),
+                "SEG start");
+            seg.end = checkindex(
+                record.read_u16(),
+                out.vertices.size(),
+                "SEG end");
+            seg.angle = record.read_u16();
+            seg.linedef = checkindex(
+                record.read_u16(),
+                out.linedefs.size(),
+                "SEG linedef");
+            seg.direction = record.read_u16();
+            seg.offset = record.read_i16();
+
+            /* everything which draws a SEG needs its front SIDEDEF */
+            if (out.front(seg) == nullptr)
+            {
+                throw std::runtime_error(
+                    "SEG on the missing side of LINEDEF "
+                    + std::to_string(seg.linedef));
+            }
+            return seg;
+        });
+    lap();
 
-    for (size_t i = 0; i < dir.size / 4; ++i)
+    /* read SSECTORS */
+    out.ssectors = readpacked<SSector>(lump("SSECTORS"));
+    for (auto &ssector : out.ssectors)
     {
-        SSector ssector{};
-        dir.read(&ssector.count, 2);
-        dir.read(&ssector.start, 2);
-        out.ssectors.push_back(ssector);
+        checkindex(ssector.start, out.segs.size(), "SSECTOR start");
+        if (   ssector.count == 0
+            || ssector.count > out.segs.size() - ssector.start)
+        {
+            throw std::runtime_error(
+                "Bad SSECTOR count ("
+                + std::to_string(ssector.start)
+                + "+"
+                + std::to_string(ssector.count)
+                + "/"
+                + std::to_string(out.segs.size())
+                + ")");
+        }
     }
-
+    lap();
 
     /* read NODES */
-    dir = wad.findlump("NODES", lvlidx);
-    dir.seek(0, SEEK_SET);
-
-    for (size_t i = 0; i < dir.size / 28; ++i)
+    out.nodes = readpacked<Node>(lump("NODES"));
+    for (auto &node : out.nodes)
     {
-        Node node{};
-
-        dir.read(&node.x, 2);
-        dir.read(&node.y, 2);
-        dir.read(&node.dx, 2);
-        dir.read(&node.dy, 2);
-
-        dir.read(&node.right_upper_y, 2);
-        dir.read(&node.right_lower_y, 2);
-        dir.read(&node.right_lower_x, 2);
-        dir.read(&node.right_upper_x, 2);
+        for (uint16_t child : {node.right, node.left})
+        {
+            if (child & 0x8000)
+            {
+                checkindex(
+                    child & 0x7FFF,
+                    out.ssectors.size(),
+                    "NODE child SSECTOR");
+            }
+            else
+            {
+                checkindex(child, out.nodes.size(), "NODE child");
+            }
+        }
+    }
+    /* the NODES have to be a tree, or walking them never ends */
+    if (!out.nodes.empty())
+    {
+        std::vector<bool> seen(out.nodes.size(), false);
+        std::vector<uint16_t> stack{(uint16_t)(out.nodes.size() - 1)};
+        while (!stack.empty())
+        {
+            auto idx = stack.back();
+            stack.pop_back();
+            if (seen[idx])
+            {
+                throw std::runtime_error(
+                    "NODE " + std::to_string(idx) + " is reached twice");
+            }
+            seen[idx] = true;
 
-        dir.read(&node.left_upper_y, 2);
-        dir.read(&node.left_lower_y, 2);
-        dir.read(&node.left_lower_x, 2);
-        dir.read(&node.left_upper_x, 2);
+            for (uint16_t child : {out.nodes[idx].right, out.nodes[idx].left})
+            {
+                if (!(child & 0x8000))
+                {
+                    stack.push_back(child);
+                }
+            }
+        }
+    }
+    else if (out.ssectors.size() > 1)
+    {
+        throw std::runtime_error("NODES missing");
+    }
+    lap();
 
-        dir.read(&node.right, 2);
-        dir.read(&node.left, 2);
 
-        out.nodes.push_back(node);
+    if (verbose)
+    {
+        printf("%s:", level.c_str());
+        for (auto &time : times)
+        {
+            printf(" %s %.3fms", time.first, time.second);
+        }
+        putchar('\n');
     }
 
     return out;
@@ -431,35 +841,28 @@ std::vector<TextureDefinition> readtexturedefs(
     WAD &wad,
     char const lumpname[9])
 {
-    DirEntry dir = wad.findlump(lumpname);
-    dir.seek(0, SEEK_SET);
+    auto lump = wad.findlump(lumpname).cursor();
 
     /* number of texturedefs in the lump */
-    uint32_t count = 0;
-    dir.read(&count, 4);
+    uint32_t count = lump.read_u32();
+    auto ptrs = lump.read_array<uint32_t>(count);
 
     std::vector<TextureDefinition> tds{};
+    tds.reserve(count);
     for (size_t i = 0; i < count; ++i)
     {
         TextureDefinition td{};
 
-        /* get the pointer to the actual texturedef */
-        uint32_t ptr = 0;
-        dir.seek(4 + (i * 4), SEEK_SET);
-        dir.read(&ptr, 4);
-
         /* read the texturedef data */
-        dir.seek(ptr, SEEK_SET);
-
-        uint16_t patchdef_count = 0;
+        lump.seek(ptrs[i]);
 
         td.name[8] = '\0';
-        dir.read(td.name, 8);
-        dir.seek(4L, SEEK_CUR);
-        dir.read(&td.width, 2);
-        dir.read(&td.height, 2);
-        dir.seek(4L, SEEK_CUR);
-        dir.read(&patchdef_count, 2);
+        lump.read_bytes(td.name, 8);
+        lump.skip(4);
+        td.width = lump.read_u16();
+        td.height = lump.read_u16();
+        lump.skip(4);
+        uint16_t patchdef_count = lump.read_u16();
 
 #ifdef wad_DO_PATCH_PGMS
         printf("%s:%dx%d,%d patches\n",
@@ -469,15 +872,17 @@ std::vector<TextureDefinition> readtexturedefs(
             patchdef_count);
 #endif
 
-        /* read all the texturedef's patchdefs */
+        /* read all the texturedef's patchdefs in one go */
+        auto patchdefs = lump.subspan(lump.tell(), patchdef_count * 10);
+        td.patchdescs.reserve(patchdef_count);
         for (size_t j = 0; j < patchdef_count; ++j)
         {
             PatchDescriptor pd{};
 
-            dir.read(&pd.x, 2);
-            dir.read(&pd.y, 2);
-            dir.read(&pd.pname_index, 2);
-            dir.seek(4, SEEK_CUR);
+            pd.x = patchdefs.read_i16();
+            pd.y = patchdefs.read_i16();
+            pd.pname_index = patchdefs.read_u16();
+            patchdefs.skip(4);
 
             td.patchdescs.push_back(pd);
         }
@@ -488,56 +893,72 @@ std::vector<TextureDefinition> readtexturedefs(
 
 
 
-Picture loadpicture(DirEntry &lump)
+/* call fn(x, row, pixels, length) for each post of a picture lump,
+ * column by column ('cursor' must be just past the header) */
+template<typename F>
+static void _readposts(
+    LumpCursor &cursor,
+    uint16_t width,
+    uint16_t height,
+    F fn)
 {
-    lump.seek(0, SEEK_SET);
-
-    Picture pic{};
-
-    lump.read(&pic.width, 2);
-    lump.read(&pic.height, 2);
-    lump.read(&pic.left, 2);
-    lump.read(&pic.top, 2);
-
-    pic.data = std::vector<uint8_t>(pic.width * pic.height, 0);
-    pic.opaque = std::vector<bool>(pic.width * pic.height, false);
+    auto colptrs = cursor.read_array<uint32_t>(width);
 
-    auto colptrs = std::vector<uint32_t>(pic.width, 0);
-    for (size_t i = 0; i < pic.width; ++i)
+    for (size_t x = 0; x < width; ++x)
     {
-        lump.read(&colptrs[i], 4);
-    }
-
-    for (size_t x = 0; x < pic.width; ++x)
-    {
-        lump.seek(colptrs[x], SEEK_SET);
+        cursor.seek(colptrs[x]);
 
         for (;;)
         {
-            uint8_t row = 0,
-                    length = 0;
-
-            lump.read(&row, 1);
+            uint8_t row = cursor.read_u8();
             if (row == 255)
             {
                 break;
             }
-            lump.read(&length, 1);
-            lump.seek(1, SEEK_CUR);
+            uint8_t length = cursor.read_u8();
 
-            for (size_t i = 0; i < length; ++i)
-            {
-                uint8_t pix = 0;
-                lump.read(&pix, 1);
+            /* skip the padding bytes either side of the post */
+            cursor.skip(1);
+            uint8_t const *post = cursor.take(length);
+            cursor.skip(1);
 
-                size_t idx = ((row + i) * pic.width) + x;
-                pic.data[idx] = pix;
-                pic.opaque[idx] = true;
-                
+            /* posts hanging off the bottom are clipped */
+            size_t end = std::min<size_t>(row + length, height);
+            if (row < end)
+            {
+                fn(x, row, post, end - row);
             }
-            lump.seek(1, SEEK_CUR);
         }
     }
+}
+
+Picture loadpicture(DirEntry &lump)
+{
+    auto cursor = lump.cursor();
+
+    Picture pic{};
+
+    pic.width = cursor.read_u16();
+    pic.height = cursor.read_u16();
+    pic.left = cursor.read_i16();
+    pic.top = cursor.read_i16();
+
+    pic.pixels = std::vector<IndexedPixel>(
+        pic.width * pic.height,
+        IndexedPixel{0, 0, {0, 0}});
+
+    _readposts(
+        cursor,
+        pic.width,
+        pic.height,
+        [&pic](size_t x, size_t row, uint8_t const *post, size_t length)
+        {
+            for (size_t y = 0; y < length; ++y)
+            {
+                size_t idx = ((row + y) * pic.width) + x;
+                pic.pixels[idx] = IndexedPixel{post[y], 0xFF, {0, 0}};
+            }
+        });
 
 #ifdef wad_DO_PATCH_PGMS
     {
@@ -547,7 +968,10 @@ Picture loadpicture(DirEntry &lump)
     if (pgm != nullptr)
     {
         fprintf(pgm, "P5\n%d %d\n255\n", pic.width, pic.height);
-        fwrite(pic.data.data(), 1, pic.width * pic.height, pgm);
+        for (auto &pixel : pic.pixels)
+        {
+            fputc(pixel.index, pgm);
+        }
         fclose(pgm);
     }
     else
@@ -563,6 +987,91 @@ Picture loadpicture(DirEntry &lump)
 
 
 
+PostPicture loadpostpicture(DirEntry &lump)
+{
+    auto cursor = lump.cursor();
+
+    PostPicture pic{};
+
+    pic.width = cursor.read_u16();
+    pic.height = cursor.read_u16();
+    pic.left = cursor.read_i16();
+    pic.top = cursor.read_i16();
+
+    pic.columns.reserve(pic.width + 1);
+
+    _readposts(
+        cursor,
+        pic.width,
+        pic.height,
+        [&pic](size_t x, size_t row, uint8_t const *post, size_t length)
+        {
+            /* start any columns up to and including this one */
+            while (pic.columns.size() <= x)
+            {
+                pic.columns.push_back(pic.posts.size());
+            }
+            pic.posts.push_back(
+                PostPicture::Post{
+                    (uint16_t)row,
+                    (uint16_t)length,
+                    (uint32_t)pic.indices.size()});
+            pic.indices.insert(pic.indices.end(), post, post + length);
+        });
+    while (pic.columns.size() <= pic.width)
+    {
+        pic.columns.push_back(pic.posts.size());
+    }
+
+    pic.posts.shrink_to_fit();
+    pic.indices.shrink_to_fit();
+    return pic;
+}
+
+
+
+/* copy the opaque pixels in 'src' over 'dst'
+ * (done 4 pixels at a time with a mask made from the alpha bytes,
+ *  so there's no per-pixel branch) */
+static void _blendrow(
+    IndexedPixel *dst,
+    IndexedPixel const *src,
+    size_t count)
+{
+    typedef uint32_t u32x4 __attribute__((vector_size(16)));
+
+    /* the alpha byte's bits, whatever the byte order is */
+    static uint32_t const alphabits =\
+        []()
+        {
+            IndexedPixel pixel{0, 0xFF, {0, 0}};
+            uint32_t bits;
+            memcpy(&bits, &pixel, sizeof(bits));
+            return bits;
+        }();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        u32x4 s, d;
+        memcpy(&s, src + i, sizeof(s));
+        memcpy(&d, dst + i, sizeof(d));
+
+        /* all 1s where the source is opaque */
+        u32x4 mask = (u32x4)((s & alphabits) != 0);
+        d = (s & mask) | (d & ~mask);
+
+        memcpy(dst + i, &d, sizeof(d));
+    }
+    for (; i < count; ++i)
+    {
+        if (src[i].alpha)
+        {
+            dst[i] = src[i];
+        }
+    }
+}
+
 Texture buildtexture(WAD &wad, TextureDefinition const &td)
 {
 #ifdef wad_DO_TEXTURE_PGMS
@@ -572,30 +1081,32 @@ Texture buildtexture(WAD &wad, TextureDefinition const &td)
     Texture tex{};
     tex.width = td.width;
     tex.height = td.height;
-    tex.data = std::vector<uint8_t>(tex.width * tex.height, 0);
-    tex.opaque = std::vector<bool>(tex.width * tex.height, false);
+    tex.pixels = std::vector<IndexedPixel>(
+        tex.width * tex.height,
+        IndexedPixel{0, 0, {0, 0}});
 
     for (auto &pd : td.patchdescs)
     {
-        auto pic = loadpicture(
-            wad.directory[wad.pnames[pd.pname_index]]);
+        auto patch = wad.patches->get(wad, pd.pname_index);
+        auto &pic = *patch;
+
+        /* clip the patch against the texture once, up front
+         * (patches can hang off any side of the texture) */
+        int const x0 = std::max<int>(0, pd.x),
+                  y0 = std::max<int>(0, pd.y),
+                  x1 = std::min<int>(td.width, pd.x + pic.width),
+                  y1 = std::min<int>(td.height, pd.y + pic.height);
+        if (x0 >= x1 || y0 >= y1)
+        {
+            continue;
+        }
 
-        for (size_t y = 0; y < pic.height; ++y)
+        for (int y = y0; y < y1; ++y)
         {
-            for (size_t x = 0; x < pic.width; ++x)
-            {
-                if (pd.y + y >= td.height || pd.x + x >= td.width)
-                {
-                    continue;
-                }
-                size_t picidx = (y * pic.width) + x;
-                size_t texidx = ((pd.y + y) * td.width) + pd.x + x;
-                if (pic.opaque[picidx])
-                {
-                    tex.data[texidx] = pic.data[picidx];
-                    tex.opaque[texidx] = true;
-                }
-            }
+            _blendrow(
+                &tex.pixels[(y * td.width) + x0],
+                &pic.pixels[((y - pd.y) * pic.width) + (x0 - pd.x)],
+                x1 - x0);
         }
     }
 
@@ -607,7 +1118,10 @@ Texture buildtexture(WAD &wad, TextureDefinition const &td)
     if (pgm != nullptr)
     {
         fprintf(pgm, "P5\n%d %d\n255\n", td.width, td.height);
-        fwrite(tex.data.data(), 1, td.width * td.height, pgm);
+        for (auto &pixel : tex.pixels)
+        {
+            fputc(pixel.index, pgm);
+        }
         fclose(pgm);
     }
     else
@@ -9,13 +9,54 @@
 
 #include <cstdio>
 
+#include <string>
+#include <utility>
+#include <vector>
 
-/* load a .WAD file from disk */
-WAD loadIWAD(FILE *f);
-void patchWAD(WAD &wad, FILE *f);
 
-/* read a .WAD file */
-void readwad(WAD &wad);
+/* print stats and timings while reading (off unless -v is given) */
+extern bool verbose;
+
+/* load a .WAD file from disk
+ * ('name' is only used to report where lumps came from) */
+WAD loadIWAD(FILE *f, std::string const &name="IWAD");
+void patchWAD(WAD &wad, FILE *f, std::string const &name="PWAD");
+
+/* patch several PWADs into the WAD, in load order
+ * (each is a name and an open file) */
+void patchWADs(
+    WAD &wad,
+    std::vector<std::pair<std::string, FILE *>> const &pwads);
+
+/* print which file every lump that didn't come from the IWAD
+ * came from */
+void printsources(WAD const &wad, FILE *out=stdout);
+
+/* read a .WAD file
+ * (if 'lazy', textures aren't composited until they're asked for
+ *  by gettexture or prefetchtextures) */
+void readwad(WAD &wad, bool lazy=false);
+
+/* index wad.sprites by prefix, frame and rotation into
+ * wad.spriteframes (readwad does this itself) */
+void buildspriteframes(WAD &wad);
+
+/* read PNAMES and the TEXTUREx definitions into wad.texturedefs,
+ * without compositing anything
+ * (textures already in wad.textures are left out) */
+void readtexturedefinitions(WAD &wad);
+
+/* get a texture, compositing it first if it hasn't been yet
+ * (the name's case doesn't matter. Returns nullptr if there's no
+ *  such texture) */
+Texture const *gettexture(WAD &wad, std::string const &name);
+
+/* composite every one of 'names' which hasn't been yet, in parallel */
+void prefetchtextures(WAD &wad, std::vector<std::string> const &names);
+
+/* the names of every texture a level's SIDEDEFs use
+ * (case-folded, see foldname) */
+std::vector<std::string> leveltextures(Level const &lvl);
 
 /* read an 'ExMy' lump */
 Level readlevel(std::string level, WAD &wad);
@@ -28,7 +69,12 @@ std::vector<TextureDefinition> readtexturedefs(
 /* load a picture */
 Picture loadpicture(DirEntry &lump);
 
-/* flatten patches into a single texture */
+/* load a picture, keeping it as column posts
+ * (see PostPicture; sprites are kept like this) */
+PostPicture loadpostpicture(DirEntry &lump);
+
+/* flatten patches into a single texture
+ * (patches come from wad.patches, which readwad sets up) */
 Texture buildtexture(WAD &wad, TextureDefinition const &td);
 
 
@@ -5,7 +5,10 @@
 #ifndef _RENDERLEVEL_H
 #define _RENDERLEVEL_H
 
+#include "atlas.hpp"
 #include "camera.hpp"
+#include "colorlut.hpp"
+#include "levelgeometry.hpp"
 #include "mesh.hpp"
 #include "program.hpp"
 #include "texture.hpp"
@@ -18,6 +21,7 @@
 #include <GL/gl.h>
 #include <GL/glu.h>
 
+#include <array>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -32,6 +36,9 @@ struct RenderThing
         bool flipx;
         glm::vec2 offset;
     };
+    /* a sprite's frames, by frame letter, each as seen from 8
+     * rotations (see SpriteFrame) */
+    typedef std::vector<std::array<SpriteDef, 8>> Frames;
 
     bool angled;
     bool cleanloop;
@@ -39,9 +46,12 @@ struct RenderThing
     int framecount;
     int frame_idx;
 
-    std::unordered_map<std::string, SpriteDef> sprites;
+    /* shared by every thing with the same sprite
+     * (nullptr if the thing has no image) */
+    Frames const *frames;
 
-    Sector *sector;
+    /* index of the SECTOR the thing is in */
+    uint16_t sector;
     glm::vec3 pos;
     double angle;
 };
@@ -102,20 +112,34 @@ struct RenderGlobals
     std::unique_ptr<Program> program;
     std::unique_ptr<Program> billboard_shader;
     std::unique_ptr<Program> automap_program;
+    std::unique_ptr<Program> atlas_program;
     glm::mat4 projection;
 
-    GLuint palette_texture;
+    /* the palettes and colormaps, on the CPU and the GPU */
+    ColorLUT lut;
+    GLuint lut_texture;
     GLuint palette_number;
 
-    GLuint colormap_texture;
-
+    /* images which are shared in the WAD share a GLTexture too */
     std::unordered_map<
         std::string,
-        std::unique_ptr<GLTexture>> textures,
+        std::shared_ptr<GLTexture>> textures,
                                     flats,
                                     sprites,
                                     menu_images,
                                     gui_images;
+
+    /* the WAD's sprite frames with their GLTextures looked up, by
+     * sprite prefix (filled in as levels' things need them) */
+    std::unordered_map<std::string, RenderThing::Frames> spriteframes;
+
+    /* the textures and flats which fit in the atlas, on the CPU and
+     * the GPU (keyed the same as 'textures' and 'flats'. Textures
+     * composited after startup are packed by RenderLevel::upload) */
+    Atlas atlas_images;
+    std::unique_ptr<GLTextureArray> atlas;
+    std::unordered_map<std::string, Atlas::Rect> atlas_textures,
+                                                 atlas_flats;
 };
 
 class RenderLevel
@@ -128,17 +152,69 @@ public:
     std::vector<RenderFlat> floors;
     std::vector<RenderFlat> ceilings;
 
+    /* every wall and flat whose image is in the atlas, drawn at once
+     * (those parts aren't in 'walls', 'floors' or 'ceilings') */
+    std::unique_ptr<AtlasMesh> batch;
+
     std::unique_ptr<Mesh> automap;
     GLuint automap_vbo;
 
+    /* do up to 'budget' pieces of the GL work left over from the
+     * constructor (each mesh counts as one), so a level can be
+     * uploaded over a few frames. Only call this from the GL thread,
+     * and not while another RenderLevel is being made (this adds to
+     * g's atlas). Returns true once the level is ready to draw */
+    bool upload(RenderGlobals &g, size_t budget=SIZE_MAX);
+
+    /* works out everything which doesn't need GL, so this doesn't have
+     * to be called from the GL thread ('g' is only read, so its atlas
+     * has to be made first). Nothing can be drawn until upload() says
+     * the level is ready */
     RenderLevel(
         Level const &lvl,
-        RenderGlobals &g,
+        LevelGeometry const &geometry,
+        RenderGlobals const &g,
         uint8_t include,
         uint8_t exclude);
     ~RenderLevel();
 
 private:
+    /* a flat which isn't in the atlas (or is sky), waiting for upload()
+     * (no vertices means sky) */
+    struct _PendingFlat
+    {
+        uint16_t sector;
+        bool ceiling;
+        std::vector<Mesh::Vertex> vertices;
+    };
+
+    /* what's left for upload() to do, in the order it does it */
+    std::vector<std::string> _thingsprites;
+    std::vector<WallQuad> _pendingwalls;
+    size_t _walls_done;
+    std::vector<_PendingFlat> _pendingflats;
+    size_t _flats_done;
+    std::vector<AtlasMesh::Vertex> _batchverts;
+    std::vector<GLuint> _batchindices;
+    std::vector<uint16_t> _atlaslayers;
+    std::vector<Mesh::Vertex> _automapverts;
+    std::vector<glm::vec4> _automapcolors;
+
+    /* add a wall quad, or a list of flat triangles, to the batch */
+    void _batchadd(
+        GeometryVertex const *v,
+        size_t count,
+        bool quad,
+        Atlas::Rect const &rect,
+        float scale,
+        uint16_t lightlevel);
+
+    /* upload the atlas layers the batch's walls were packed into */
+    void _uploadatlas(RenderGlobals &g);
+
+    void _uploadwall(WallQuad const &quad, RenderGlobals &g);
+    void _uploadflat(_PendingFlat const &flat, RenderGlobals &g);
+
     RenderLevel(RenderLevel const &) = delete;
     RenderLevel &operator=(RenderLevel const &) = delete;
 };
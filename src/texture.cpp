@@ -48,3 +48,73 @@ GLuint GLTexture::id(void) const
     return _id;
 }
 
+
+
+
+GLTextureArray::GLTextureArray(
+    size_t width,
+    size_t height,
+    std::vector<void const *> const &data)
+:   _id{0},
+    width{width},
+    height{height},
+    layers{data.size()}
+{
+    glGenTextures(1, &_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _id);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    /* allocate every layer, then copy each one in */
+    glTexImage3D(
+        GL_TEXTURE_2D_ARRAY,
+        0,
+        GL_RGBA8UI,
+        width, height, layers,
+        0,
+        GL_RGBA_INTEGER,
+        GL_UNSIGNED_BYTE,
+        nullptr);
+    for (size_t i = 0; i < layers; ++i)
+    {
+        glTexSubImage3D(
+            GL_TEXTURE_2D_ARRAY,
+            0,
+            0, 0, i,
+            width, height, 1,
+            GL_RGBA_INTEGER,
+            GL_UNSIGNED_BYTE,
+            data[i]);
+    }
+}
+
+GLTextureArray::~GLTextureArray()
+{
+    glDeleteTextures(1, &_id);
+}
+
+void GLTextureArray::bind(void) const
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _id);
+}
+
+GLuint GLTextureArray::id(void) const
+{
+    return _id;
+}
+
+void GLTextureArray::update(size_t layer, void const *data)
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _id);
+    glTexSubImage3D(
+        GL_TEXTURE_2D_ARRAY,
+        0,
+        0, 0, layer,
+        width, height, 1,
+        GL_RGBA_INTEGER,
+        GL_UNSIGNED_BYTE,
+        data);
+}
@@ -9,6 +9,8 @@
 #include <GL/gl.h>
 #include <GL/glu.h>
 
+#include <vector>
+
 
 
 /* IMPORTANT:
@@ -45,5 +47,41 @@ public:
 };
 
 
+/* an array of equally sized layers, in the same format as GLTexture
+ * (used for the texture atlas, see atlas.hpp. There's no wrapping,
+ *  the shader has to do it itself) */
+class GLTextureArray
+{
+private:
+    GLuint _id;
+
+
+    /* no copying allowed! */
+    GLTextureArray &operator=(GLTextureArray const &other) = delete;
+    GLTextureArray(GLTextureArray const &other) = delete;
+
+public:
+
+    size_t const width, height, layers;
+
+    /* bind the texture */
+    void bind(void) const;
+
+    /* get the Texture's ID */
+    GLuint id(void) const;
+
+    /* copy a layer in again, after it's changed */
+    void update(size_t layer, void const *data);
+
+
+    /* 'data' has one pointer per layer */
+    GLTextureArray(
+        size_t width,
+        size_t height,
+        std::vector<void const *> const &data);
+    ~GLTextureArray();
+};
+
+
 #endif
 
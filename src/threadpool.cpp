@@ -0,0 +1,205 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+
+
+ThreadPool::ThreadPool(size_t threads)
+:   _queues{},
+    _threads{},
+    _pending{0},
+    _lock{},
+    _wake{},
+    _stop{false},
+    _next{0}
+{
+    if (threads == 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i)
+    {
+        _queues.emplace_back(new Queue{});
+    }
+    for (size_t i = 0; i < threads; ++i)
+    {
+        _threads.emplace_back(&ThreadPool::_worker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard{_lock};
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto &thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::size(void) const
+{
+    return _threads.size();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    /* count the task before it's visible, so _pending can't drop
+     * below zero if someone takes it straight away */
+    {
+        std::lock_guard<std::mutex> guard{_lock};
+        _pending++;
+    }
+    auto &queue = *_queues[_next++ % _queues.size()];
+    {
+        std::lock_guard<std::mutex> guard{queue.lock};
+        queue.tasks.push_back(std::move(task));
+    }
+    _wake.notify_one();
+}
+
+void ThreadPool::parallel_for(size_t count, std::function<void(size_t)> fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    struct Batch
+    {
+        std::atomic<size_t> remaining;
+        std::mutex lock;
+        std::condition_variable done;
+        std::exception_ptr error;
+    } batch{};
+
+    /* split the range into a few chunks per thread, so there's
+     * something left to steal when the chunks are uneven */
+    size_t const grain = std::max<size_t>(1, count / (size() * 4));
+    size_t const chunks = (count + grain - 1) / grain;
+    batch.remaining = chunks;
+
+    for (size_t c = 0; c < chunks; ++c)
+    {
+        size_t const first = c * grain,
+                     last = std::min(count, first + grain);
+        submit(
+            [&batch, &fn, first, last]()
+            {
+                try
+                {
+                    for (size_t i = first; i < last; ++i)
+                    {
+                        fn(i);
+                    }
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> guard{batch.lock};
+                    if (!batch.error)
+                    {
+                        batch.error = std::current_exception();
+                    }
+                }
+                /* NOTE: the batch can go away as soon as remaining
+                 * hits 0, so it's only touched under the lock */
+                std::lock_guard<std::mutex> guard{batch.lock};
+                if (--batch.remaining == 0)
+                {
+                    batch.done.notify_all();
+                }
+            });
+    }
+
+    /* help out until the batch is finished */
+    std::function<void()> task{};
+    while (batch.remaining != 0)
+    {
+        if (_take(_queues.size(), task))
+        {
+            task();
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock{batch.lock};
+            batch.done.wait(
+                lock,
+                [&batch](){ return batch.remaining == 0; });
+        }
+    }
+
+    /* wait for the last task to let go of the batch */
+    std::lock_guard<std::mutex> guard{batch.lock};
+    if (batch.error)
+    {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+ThreadPool &ThreadPool::global(void)
+{
+    static ThreadPool pool{};
+    return pool;
+}
+
+
+
+bool ThreadPool::_take(size_t self, std::function<void()> &task)
+{
+    /* our own queue is used LIFO... */
+    if (self < _queues.size())
+    {
+        auto &queue = *_queues[self];
+        std::lock_guard<std::mutex> guard{queue.lock};
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            _pending--;
+            return true;
+        }
+    }
+    /* ...and everyone else's is stolen from FIFO */
+    for (size_t i = 1; i <= _queues.size(); ++i)
+    {
+        auto &queue = *_queues[(self + i) % _queues.size()];
+        std::lock_guard<std::mutex> guard{queue.lock};
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            _pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::_worker(size_t self)
+{
+    std::function<void()> task{};
+    for (;;)
+    {
+        if (_take(self, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock{_lock};
+        _wake.wait(lock, [this](){ return _stop || _pending != 0; });
+        if (_stop && _pending == 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+/* work-stealing thread pool
+ * (each worker has its own queue, and steals from the others
+ *  when it runs dry) */
+class ThreadPool
+{
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+
+    /* number of queued tasks which haven't been taken yet */
+    std::atomic<size_t> _pending;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    bool _stop;
+
+    /* round robin counter for spreading tasks between the queues */
+    std::atomic<size_t> _next;
+
+
+    /* take a task, preferring queue 'self'
+     * (self >= number of queues means 'no queue of our own') */
+    bool _take(size_t self, std::function<void()> &task);
+
+    void _worker(size_t self);
+
+
+    /* no copying allowed! */
+    ThreadPool &operator=(ThreadPool const &other) = delete;
+    ThreadPool(ThreadPool const &other) = delete;
+
+public:
+
+    /* number of worker threads */
+    size_t size(void) const;
+
+    /* queue a task */
+    void submit(std::function<void()> task);
+
+    /* call fn(i) for every i in [0, count), spread across the pool
+     * (the calling thread helps out, and this returns once every
+     *  call is finished. If any calls throw, the first exception is
+     *  rethrown here) */
+    void parallel_for(size_t count, std::function<void(size_t)> fn);
+
+
+    /* the pool shared by the whole program */
+    static ThreadPool &global(void);
+
+
+    /* threads=0 means one per core */
+    ThreadPool(size_t threads=0);
+    ~ThreadPool();
+};
+
+
+#endif
@@ -0,0 +1,902 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "triangulate.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+
+
+/* a point of the loops, wound so the inside is always on the left */
+struct _Point
+{
+    int64_t x, y;
+    uint32_t prev, next;
+    /* where the point is in triangulate's input */
+    uint32_t index;
+};
+
+/* what happens at a point as the sweep line passes it
+ * (see de Berg et al., "Computational Geometry", chapter 3) */
+enum _PointType
+{
+    /* both neighbours are below, and it's convex: a piece starts */
+    POINT_START,
+    /* both neighbours are below, and it's reflex: a piece splits */
+    POINT_SPLIT,
+    /* both neighbours are above, and it's convex: a piece ends */
+    POINT_END,
+    /* both neighbours are above, and it's reflex: two pieces merge */
+    POINT_MERGE,
+    /* on the left side of a piece (the inside is to its right) */
+    POINT_LEFT,
+    /* on the right side of a piece */
+    POINT_RIGHT,
+};
+
+
+static int64_t _cross(
+    int64_t ax, int64_t ay,
+    int64_t bx, int64_t by)
+{
+    return (ax * by) - (ay * bx);
+}
+
+/* the order the sweep line meets points in: top to bottom, then left
+ * to right (so there are no horizontal edges to worry about), then by
+ * index (so points which are in the same place aren't equal) */
+static bool _above(
+    std::vector<_Point> const &points,
+    uint32_t a,
+    uint32_t b)
+{
+    auto &pa = points[a],
+         &pb = points[b];
+    if (pa.y != pb.y)
+    {
+        return pa.y > pb.y;
+    }
+    if (pa.x != pb.x)
+    {
+        return pa.x < pb.x;
+    }
+    return a < b;
+}
+
+
+/* twice the signed area of a loop (positive if it's counterclockwise) */
+static int64_t _area(std::vector<Vertex> const &loop)
+{
+    int64_t area = 0;
+    for (size_t i = 0; i < loop.size(); ++i)
+    {
+        auto &p0 = loop[i],
+             &p1 = loop[(i + 1) % loop.size()];
+        area += _cross(p0.x, p0.y, p1.x, p1.y);
+    }
+    return area;
+}
+
+/* -1 if 'p' is on the loop, otherwise 1 if it's inside and 0 if not */
+static int _pointinloop(Vertex const &p, std::vector<Vertex> const &loop)
+{
+    bool inside = false;
+    for (size_t i = 0; i < loop.size(); ++i)
+    {
+        auto &a = loop[i],
+             &b = loop[(i + 1) % loop.size()];
+
+        int64_t const cross = _cross(b.x - a.x, b.y - a.y, p.x - a.x, p.y - a.y);
+        if (   cross == 0
+            && std::min(a.x, b.x) <= p.x && p.x <= std::max(a.x, b.x)
+            && std::min(a.y, b.y) <= p.y && p.y <= std::max(a.y, b.y))
+        {
+            return -1;
+        }
+
+        /* does a ray going right from p cross the edge? */
+        if ((a.y > p.y) != (b.y > p.y))
+        {
+            if ((cross > 0) == (b.y > a.y))
+            {
+                inside = !inside;
+            }
+        }
+    }
+    return inside? 1 : 0;
+}
+
+/* split a ring wherever it comes back to a point it's already been
+ * through, so the rings which come out only touch each other there
+ * (a spike, going out and straight back, comes out as a ring of two
+ *  points, which is dropped along with anything else under three) */
+static void _splitring(
+    std::vector<Vertex> const &ring,
+    std::vector<uint32_t> const &index,
+    std::vector<std::vector<Vertex>> &rings,
+    std::vector<std::vector<uint32_t>> &indices)
+{
+    auto key = [](Vertex const &v)
+    {
+        return ((uint32_t)(uint16_t)v.x << 16) | (uint16_t)v.y;
+    };
+    auto keep = [&rings, &indices](
+        std::vector<Vertex> &&r,
+        std::vector<uint32_t> &&i)
+    {
+        if (r.size() >= 3)
+        {
+            rings.push_back(std::move(r));
+            indices.push_back(std::move(i));
+        }
+    };
+
+    /* the ring so far, with where each of its points is in it */
+    std::unordered_map<uint32_t, size_t> where{};
+    std::vector<Vertex> points{};
+    std::vector<uint32_t> pointindex{};
+    for (size_t i = 0; i < ring.size(); ++i)
+    {
+        auto it = where.find(key(ring[i]));
+        if (it == where.end())
+        {
+            where.emplace(key(ring[i]), points.size());
+            points.push_back(ring[i]);
+            pointindex.push_back(index[i]);
+            continue;
+        }
+
+        /* everything since the last time through here is a ring */
+        size_t const j = it->second;
+        for (size_t k = j + 1; k < points.size(); ++k)
+        {
+            where.erase(key(points[k]));
+        }
+        keep(
+            {points.begin() + j, points.end()},
+            {pointindex.begin() + j, pointindex.end()});
+        points.resize(j + 1);
+        pointindex.resize(j + 1);
+    }
+    keep(std::move(points), std::move(pointindex));
+}
+
+/* do edges p0-p1 and q0-q1 cross, or run along each other?
+ * (edges which only touch don't count) */
+static bool _edgescross(
+    _Point const &p0, _Point const &p1,
+    _Point const &q0, _Point const &q1)
+{
+    int64_t const px = p1.x - p0.x,
+                  py = p1.y - p0.y,
+                  qx = q1.x - q0.x,
+                  qy = q1.y - q0.y;
+    int64_t const d0 = _cross(px, py, q0.x - p0.x, q0.y - p0.y),
+                  d1 = _cross(px, py, q1.x - p0.x, q1.y - p0.y),
+                  d2 = _cross(qx, qy, p0.x - q0.x, p0.y - q0.y),
+                  d3 = _cross(qx, qy, p1.x - q0.x, p1.y - q0.y);
+    if (   ((d0 > 0 && d1 < 0) || (d0 < 0 && d1 > 0))
+        && ((d2 > 0 && d3 < 0) || (d2 < 0 && d3 > 0)))
+    {
+        return true;
+    }
+    if (d0 != 0 || d1 != 0)
+    {
+        return false;
+    }
+
+    /* on the same line: do they share more than a point? */
+    int64_t const length = (px * px) + (py * py),
+                  t0 = ((q0.x - p0.x) * px) + ((q0.y - p0.y) * py),
+                  t1 = ((q1.x - p0.x) * px) + ((q1.y - p0.y) * py);
+    return    std::max<int64_t>(0, std::min(t0, t1))
+            < std::min(length, std::max(t0, t1));
+}
+
+/* the state of the sweep line
+ * (edge 'e' goes from point e to the point after it) */
+struct _Sweep
+{
+    std::vector<_Point> const &points;
+    /* the point the sweep line's at */
+    int64_t px, py;
+
+    uint32_t upper(uint32_t e) const
+    {
+        auto next = points[e].next;
+        return _above(points, e, next)? e : next;
+    }
+
+    uint32_t lower(uint32_t e) const
+    {
+        auto next = points[e].next;
+        return _above(points, e, next)? next : e;
+    }
+
+    /* where an edge crosses the sweep line, as num/den (den > 0) */
+    void x(uint32_t e, int64_t &num, int64_t &den) const
+    {
+        auto &u = points[upper(e)],
+             &l = points[lower(e)];
+        if (u.y == l.y)
+        {
+            /* the sweep line is along a horizontal edge, and it only
+             * gets to be in the status while the sweep point's on it */
+            num = std::min(std::max(px, u.x), l.x);
+            den = 1;
+            return;
+        }
+        den = u.y - l.y;
+        num = (u.x * den) + ((u.y - py) * (l.x - u.x));
+    }
+
+    /* compare where an edge crosses the sweep line with the sweep
+     * point (<0 if it's to the left) */
+    int64_t compare(uint32_t e) const
+    {
+        int64_t num, den;
+        x(e, num, den);
+        return num - (px * den);
+    }
+
+    /* true if edge 'a' is left of edge 'b' on the sweep line */
+    bool less(uint32_t a, uint32_t b) const
+    {
+        if (a == b)
+        {
+            return false;
+        }
+
+        int64_t na, da, nb, db;
+        x(a, na, da);
+        x(b, nb, db);
+        if (na * db != nb * da)
+        {
+            return na * db < nb * da;
+        }
+
+        /* they meet on the sweep line, so go by the direction they
+         * come into or leave the point they meet at from */
+        auto &ua = points[upper(a)], &la = points[lower(a)],
+             &ub = points[upper(b)], &lb = points[lower(b)];
+        int64_t const cross = _cross(
+            la.x - ua.x, la.y - ua.y,
+            lb.x - ub.x, lb.y - ub.y);
+
+        int64_t const side = na - (px * da);
+        bool aends = false,
+             bends = false;
+        if (side == 0)
+        {
+            aends = (la.x == px && la.y == py);
+            bends = (lb.x == px && lb.y == py);
+        }
+        else
+        {
+            /* edges meeting ahead of the sweep point end there, and
+             * edges meeting behind it started there */
+            aends = bends = (side > 0);
+        }
+
+        if (aends != bends)
+        {
+            return aends;
+        }
+        if (cross != 0)
+        {
+            return aends? cross < 0 : cross > 0;
+        }
+        return a < b;
+    }
+};
+
+/* stands in for the sweep point when searching the status */
+struct _Probe
+{
+};
+
+struct _EdgeLess
+{
+    using is_transparent = void;
+
+    _Sweep const *sweep;
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        return sweep->less(a, b);
+    }
+    bool operator()(uint32_t a, _Probe) const
+    {
+        return sweep->compare(a) < 0;
+    }
+    bool operator()(_Probe, uint32_t b) const
+    {
+        return sweep->compare(b) > 0;
+    }
+};
+
+/* do any of the loops' edges cross, or run along each other?
+ * (Shamos and Hoey's sweep: two edges have to be next to each other
+ *  on the sweep line before they cross, so each edge only needs
+ *  checking against its neighbours as they change. 'order' is the
+ *  points from the top down) */
+static bool _crossing(
+    std::vector<_Point> const &points,
+    std::vector<uint32_t> const &order)
+{
+    size_t const n = points.size();
+    _Sweep sweep{points, 0, 0};
+    typedef std::set<uint32_t, _EdgeLess> Status;
+    Status status{_EdgeLess{&sweep}};
+    std::vector<Status::iterator> where(n, status.end());
+
+    auto cross = [&](Status::iterator a, Status::iterator b)
+    {
+        return _edgescross(
+            points[*a], points[points[*a].next],
+            points[*b], points[points[*b].next]);
+    };
+
+    /* points in the same place are done together, taking out every
+     * edge which ends there before putting in any which start there */
+    for (size_t i = 0; i < n;)
+    {
+        sweep.px = points[order[i]].x;
+        sweep.py = points[order[i]].y;
+        size_t end = i;
+        while (   end < n
+               && points[order[end]].x == sweep.px
+               && points[order[end]].y == sweep.py)
+        {
+            end++;
+        }
+
+        for (size_t k = i; k < end; ++k)
+        {
+            auto const v = order[k];
+            for (auto e : {points[v].prev, v})
+            {
+                if (sweep.lower(e) != v)
+                {
+                    continue;
+                }
+                auto next = status.erase(where[e]);
+                if (   next != status.begin()
+                    && next != status.end()
+                    && cross(std::prev(next), next))
+                {
+                    return true;
+                }
+            }
+        }
+        for (size_t k = i; k < end; ++k)
+        {
+            auto const v = order[k];
+            for (auto e : {points[v].prev, v})
+            {
+                if (sweep.upper(e) != v)
+                {
+                    continue;
+                }
+                auto it = where[e] = status.insert(e).first;
+                if (   (it != status.begin() && cross(std::prev(it), it))
+                    || (   std::next(it) != status.end()
+                        && cross(it, std::next(it))))
+                {
+                    return true;
+                }
+            }
+        }
+        i = end;
+    }
+    return false;
+}
+
+
+/* add a triangle, counterclockwise, unless it has no area */
+static void _emit(
+    std::vector<_Point> const &points,
+    uint32_t a,
+    uint32_t b,
+    uint32_t c,
+    std::vector<uint32_t> &out)
+{
+    auto &pa = points[a],
+         &pb = points[b],
+         &pc = points[c];
+    auto const area = _cross(
+        pb.x - pa.x, pb.y - pa.y,
+        pc.x - pa.x, pc.y - pa.y);
+    if (area == 0)
+    {
+        return;
+    }
+    if (area < 0)
+    {
+        std::swap(b, c);
+    }
+    out.push_back(points[a].index);
+    out.push_back(points[b].index);
+    out.push_back(points[c].index);
+}
+
+/* triangulate a y-monotone piece, given counterclockwise
+ * (the points are taken top to bottom, keeping a stack of the reflex
+ *  chain which hasn't been cut off yet, so it's linear) */
+static void _triangulatemonotone(
+    std::vector<_Point> const &points,
+    std::vector<uint32_t> const &face,
+    std::vector<uint32_t> &out)
+{
+    size_t const k = face.size();
+    if (k < 3)
+    {
+        return;
+    }
+
+    size_t top = 0,
+           bottom = 0;
+    for (size_t i = 1; i < k; ++i)
+    {
+        if (_above(points, face[i], face[top]))
+        {
+            top = i;
+        }
+        if (_above(points, face[bottom], face[i]))
+        {
+            bottom = i;
+        }
+    }
+
+    /* merge the two sides into one list, top to bottom
+     * (going counterclockwise from the top goes down the left side,
+     *  'true' marks the points on it) */
+    std::vector<std::pair<uint32_t, bool>> sorted{};
+    sorted.reserve(k);
+    sorted.push_back({face[top], true});
+    size_t l = (top + 1) % k,
+           r = (top + k - 1) % k;
+    while (sorted.size() < k)
+    {
+        bool left = true;
+        if (r == bottom)
+        {
+            left = true;
+        }
+        else if (l == bottom)
+        {
+            left = false;
+        }
+        else
+        {
+            left = _above(points, face[l], face[r]);
+        }
+
+        if (left)
+        {
+            sorted.push_back({face[l], true});
+            l = (l + 1) % k;
+        }
+        else
+        {
+            sorted.push_back({face[r], false});
+            r = (r + k - 1) % k;
+        }
+    }
+
+    /* can the triangle u, a, b (a is on top of the stack, and b under
+     * it) be cut off? */
+    auto convex = [&points](
+        std::pair<uint32_t, bool> const &u,
+        uint32_t a,
+        uint32_t b)
+    {
+        auto &pu = points[u.first],
+             &pa = points[a],
+             &pb = points[b];
+        if (u.second)
+        {
+            return _cross(
+                pa.x - pb.x, pa.y - pb.y,
+                pu.x - pa.x, pu.y - pa.y) > 0;
+        }
+        return _cross(
+            pa.x - pu.x, pa.y - pu.y,
+            pb.x - pa.x, pb.y - pa.y) > 0;
+    };
+
+    std::vector<std::pair<uint32_t, bool>> stack{sorted[0], sorted[1]};
+    for (size_t j = 2; j < k - 1; ++j)
+    {
+        auto &u = sorted[j];
+        if (u.second != stack.back().second)
+        {
+            /* on the other side: everything on the stack can see it */
+            for (size_t i = 0; i + 1 < stack.size(); ++i)
+            {
+                _emit(points, u.first, stack[i].first, stack[i + 1].first, out);
+            }
+            auto last = stack.back();
+            stack = {last, u};
+        }
+        else
+        {
+            /* on the same side: cut off triangles until the chain's
+             * reflex again */
+            auto last = stack.back();
+            stack.pop_back();
+            while (!stack.empty() && convex(u, last.first, stack.back().first))
+            {
+                _emit(points, u.first, last.first, stack.back().first, out);
+                last = stack.back();
+                stack.pop_back();
+            }
+            stack.push_back(last);
+            stack.push_back(u);
+        }
+    }
+
+    auto &u = sorted[k - 1];
+    for (size_t i = 0; i + 1 < stack.size(); ++i)
+    {
+        _emit(points, u.first, stack[i].first, stack[i + 1].first, out);
+    }
+}
+
+
+
+std::vector<uint32_t> triangulate(
+    std::vector<std::vector<Vertex>> const &loops)
+{
+    /* drop repeated points, remembering where the rest came from */
+    std::vector<std::vector<Vertex>> rings{};
+    std::vector<std::vector<uint32_t>> indices{};
+    uint32_t base = 0;
+    for (auto &loop : loops)
+    {
+        std::vector<Vertex> ring{};
+        std::vector<uint32_t> index{};
+        for (size_t i = 0; i < loop.size(); ++i)
+        {
+            if (   ring.empty()
+                || ring.back().x != loop[i].x
+                || ring.back().y != loop[i].y)
+            {
+                ring.push_back(loop[i]);
+                index.push_back(base + i);
+            }
+        }
+        while (   ring.size() > 1
+               && ring.front().x == ring.back().x
+               && ring.front().y == ring.back().y)
+        {
+            ring.pop_back();
+            index.pop_back();
+        }
+        base += loop.size();
+
+        _splitring(ring, index, rings, indices);
+    }
+
+    /* wind solid loops counterclockwise and holes clockwise, so the
+     * inside is always on the left
+     * (a loop's depth is how many others it's inside of, going by
+     *  the first of its points which isn't on the other loop) */
+    std::vector<_Point> points{};
+    for (size_t i = 0; i < rings.size(); ++i)
+    {
+        size_t depth = 0;
+        for (size_t j = 0; j < rings.size(); ++j)
+        {
+            if (i == j)
+            {
+                continue;
+            }
+            for (auto &p : rings[i])
+            {
+                auto inside = _pointinloop(p, rings[j]);
+                if (inside != -1)
+                {
+                    depth += inside;
+                    break;
+                }
+            }
+        }
+
+        bool const reverse = (_area(rings[i]) > 0) != (depth % 2 == 0);
+        uint32_t const first = points.size(),
+                       count = rings[i].size();
+        for (uint32_t k = 0; k < count; ++k)
+        {
+            uint32_t const src = reverse? count - 1 - k : k;
+            points.push_back(_Point{
+                rings[i][src].x,
+                rings[i][src].y,
+                first + ((k + count - 1) % count),
+                first + ((k + 1) % count),
+                indices[i][src]});
+        }
+    }
+
+    size_t const n = points.size();
+    std::vector<uint32_t> out{};
+    if (n < 3)
+    {
+        return out;
+    }
+
+    std::vector<uint32_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(
+        order.begin(),
+        order.end(),
+        [&points](uint32_t a, uint32_t b)
+        {
+            return _above(points, a, b);
+        });
+
+    /* crossing edges would leave the status out of order */
+    if (_crossing(points, order))
+    {
+        return out;
+    }
+
+
+    /* +----------------------------------------------------------+ */
+    /* |              Split into y-monotone pieces                | */
+    /* +----------------------------------------------------------+ */
+    std::vector<_PointType> types(n);
+    for (uint32_t v = 0; v < n; ++v)
+    {
+        auto &p = points[v],
+             &prev = points[p.prev],
+             &next = points[p.next];
+        bool const prevbelow = _above(points, v, p.prev),
+                   nextbelow = _above(points, v, p.next);
+        bool const convex = _cross(
+            p.x - prev.x, p.y - prev.y,
+            next.x - p.x, next.y - p.y) > 0;
+
+        if (prevbelow && nextbelow)
+        {
+            types[v] = convex? POINT_START : POINT_SPLIT;
+        }
+        else if (!prevbelow && !nextbelow)
+        {
+            types[v] = convex? POINT_END : POINT_MERGE;
+        }
+        else
+        {
+            types[v] = prevbelow? POINT_RIGHT : POINT_LEFT;
+        }
+    }
+
+    /* the status holds the edges crossing the sweep line with the
+     * inside on their right, left to right. Each one's helper is the
+     * lowest point above the sweep line which can see it */
+    _Sweep sweep{points, 0, 0};
+    typedef std::set<uint32_t, _EdgeLess> Status;
+    Status status{_EdgeLess{&sweep}};
+    std::vector<Status::iterator> where(n, status.end());
+    std::vector<uint8_t> instatus(n, 0);
+    std::vector<uint32_t> helper(n, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> diagonals{};
+
+    auto insert = [&](uint32_t e, uint32_t v)
+    {
+        where[e] = status.insert(e).first;
+        instatus[e] = 1;
+        helper[e] = v;
+    };
+    auto remove = [&](uint32_t e)
+    {
+        if (instatus[e])
+        {
+            status.erase(where[e]);
+            instatus[e] = 0;
+        }
+    };
+    /* the edge directly left of the sweep point (or -1) */
+    auto leftof = [&](void) -> int64_t
+    {
+        auto it = status.lower_bound(_Probe{});
+        if (it == status.begin())
+        {
+            return -1;
+        }
+        return *std::prev(it);
+    };
+    /* join 'v' to an edge's helper if it's a merge point */
+    auto joinmerge = [&](uint32_t e, uint32_t v)
+    {
+        if (instatus[e] && types[helper[e]] == POINT_MERGE)
+        {
+            diagonals.push_back({v, helper[e]});
+        }
+    };
+
+    for (auto v : order)
+    {
+        sweep.px = points[v].x;
+        sweep.py = points[v].y;
+
+        uint32_t const prevedge = points[v].prev;
+        int64_t left = -1;
+        switch (types[v])
+        {
+        case POINT_START:
+            insert(v, v);
+            break;
+
+        case POINT_END:
+            joinmerge(prevedge, v);
+            remove(prevedge);
+            break;
+
+        case POINT_SPLIT:
+            left = leftof();
+            if (left != -1)
+            {
+                diagonals.push_back({v, helper[left]});
+                helper[left] = v;
+            }
+            insert(v, v);
+            break;
+
+        case POINT_MERGE:
+            joinmerge(prevedge, v);
+            remove(prevedge);
+            left = leftof();
+            if (left != -1)
+            {
+                joinmerge(left, v);
+                helper[left] = v;
+            }
+            break;
+
+        case POINT_LEFT:
+            joinmerge(prevedge, v);
+            remove(prevedge);
+            insert(v, v);
+            break;
+
+        case POINT_RIGHT:
+            left = leftof();
+            if (left != -1)
+            {
+                joinmerge(left, v);
+                helper[left] = v;
+            }
+            break;
+        }
+    }
+
+
+    /* +----------------------------------------------------------+ */
+    /* |                   Walk the pieces                        | */
+    /* +----------------------------------------------------------+ */
+    /* half-edges 0..n-1 are the loops' edges, n+2k and n+2k+1 are the
+     * two ways along diagonal k */
+    size_t const halfedges = n + (2 * diagonals.size());
+    auto from = [&](uint32_t h) -> uint32_t
+    {
+        if (h < n)
+        {
+            return h;
+        }
+        auto &d = diagonals[(h - n) / 2];
+        return ((h - n) % 2 == 0)? d.first : d.second;
+    };
+    auto to = [&](uint32_t h) -> uint32_t
+    {
+        if (h < n)
+        {
+            return points[h].next;
+        }
+        auto &d = diagonals[(h - n) / 2];
+        return ((h - n) % 2 == 0)? d.second : d.first;
+    };
+
+    /* sort the diagonals leaving each point counterclockwise, starting
+     * from its loop edge (they're all inside the corner between its
+     * loop edges, so this is the order they're in going round it) */
+    std::vector<uint32_t> outgoing(halfedges - n);
+    std::iota(outgoing.begin(), outgoing.end(), n);
+    std::sort(
+        outgoing.begin(),
+        outgoing.end(),
+        [&](uint32_t a, uint32_t b)
+        {
+            auto const v = from(a);
+            if (v != from(b))
+            {
+                return v < from(b);
+            }
+
+            auto &p = points[v],
+                 &next = points[p.next],
+                 &pa = points[to(a)],
+                 &pb = points[to(b)];
+            int64_t const rx = next.x - p.x,
+                          ry = next.y - p.y,
+                          ax = pa.x - p.x,
+                          ay = pa.y - p.y,
+                          bx = pb.x - p.x,
+                          by = pb.y - p.y;
+            auto half = [rx, ry](int64_t dx, int64_t dy)
+            {
+                auto const cross = _cross(rx, ry, dx, dy);
+                return cross < 0 || (cross == 0 && (rx * dx) + (ry * dy) < 0);
+            };
+
+            bool const ha = half(ax, ay),
+                       hb = half(bx, by);
+            if (ha != hb)
+            {
+                return hb;
+            }
+            return _cross(ax, ay, bx, by) > 0;
+        });
+
+    std::vector<uint32_t> first(n + 1, 0),
+                          rank(halfedges, 0);
+    for (size_t i = 0; i < outgoing.size(); ++i)
+    {
+        first[from(outgoing[i]) + 1]++;
+    }
+    for (size_t v = 0; v < n; ++v)
+    {
+        first[v + 1] += first[v];
+    }
+    for (size_t i = 0; i < outgoing.size(); ++i)
+    {
+        rank[outgoing[i]] = i - first[from(outgoing[i])] + 1;
+    }
+
+    /* the next half-edge round the piece on this one's left: the first
+     * one clockwise from the way back */
+    auto nextedge = [&](uint32_t h) -> uint32_t
+    {
+        auto const v = to(h);
+        size_t r = 0;
+        if (h < n)
+        {
+            r = first[v + 1] - first[v] + 1;
+        }
+        else
+        {
+            auto const twin = n + ((h - n) ^ 1);
+            r = rank[twin];
+        }
+        return (r > 1)? outgoing[first[v] + r - 2] : v;
+    };
+
+    std::vector<uint8_t> visited(halfedges, 0);
+    std::vector<uint32_t> face{};
+    for (uint32_t start = 0; start < halfedges; ++start)
+    {
+        if (visited[start])
+        {
+            continue;
+        }
+
+        face.clear();
+        uint32_t h = start;
+        while (!visited[h])
+        {
+            visited[h] = 1;
+            face.push_back(from(h));
+            h = nextedge(h);
+        }
+        if (h == start)
+        {
+            _triangulatemonotone(points, face, out);
+        }
+    }
+    return out;
+}
@@ -0,0 +1,39 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _TRIANGULATE_H
+#define _TRIANGULATE_H
+
+#include "wad.hpp"
+
+#include <cstdint>
+
+#include <vector>
+
+
+/* Triangulation:
+ *  Sweeps down the loops splitting the area into y-monotone pieces,
+ *  which are then triangulated one by one, so it's O(n log n) overall
+ *  and holes need no special treatment. Everything is done with
+ *  integer math on the map's own coordinates, so nothing depends on
+ *  rounding. Loops which cross themselves or each other don't have a
+ *  well-defined inside (and would throw the sweep out of order), so
+ *  they're checked for first and give no triangles at all. Loops may
+ *  still touch, eg. two which share a point, and a loop which goes
+ *  through a point twice is taken as two loops touching there. */
+
+/* triangulate the area inside some loops, with the even-odd rule
+ * (so a loop inside another one is a hole, a loop inside that is
+ *  solid again, and so on)
+ *  - each loop is a ring of points (the last one joins back to the
+ *    first) and can be wound either way
+ *  - returns triples of indices of the loops' points, counting through
+ *    the loops in order, with every triangle counterclockwise
+ *  - degenerate triangles (with no area) are left out
+ *  - returns nothing if any two edges cross, or run along each other */
+std::vector<uint32_t> triangulate(
+    std::vector<std::vector<Vertex>> const &loops);
+
+
+#endif
@@ -3,22 +3,155 @@
  */
 
 #include "wad.hpp"
+#include "wadfile.hpp"
 
+#include <cctype>
 #include <cstring>
 
+#include <algorithm>
 #include <stdexcept>
 
 
 
+LumpCursor::LumpCursor(uint8_t const *data, size_t size, char const *name)
+:   _data{data},
+    _size{size},
+    _pos{0}
+{
+    strncpy(_name, name, 8);
+    _name[8] = '\0';
+}
+
+void LumpCursor::_check(size_t count) const
+{
+    if (count > _size - _pos)
+    {
+        throw std::out_of_range{
+            "LumpCursor(\""
+            + std::string{_name}
+            + "\") -- "
+            + std::to_string(_pos)
+            + "+"
+            + std::to_string(count)
+            + "/"
+            + std::to_string(_size)};
+    }
+}
+
+void LumpCursor::seek(size_t pos)
+{
+    if (pos > _size)
+    {
+        throw std::out_of_range{
+            "LumpCursor(\""
+            + std::string{_name}
+            + "\")::seek -- "
+            + std::to_string(pos)
+            + "/"
+            + std::to_string(_size)};
+    }
+    _pos = pos;
+}
+
+void LumpCursor::skip(size_t count)
+{
+    _check(count);
+    _pos += count;
+}
+
+uint8_t LumpCursor::read_u8(void)
+{
+    _check(1);
+    return _data[_pos++];
+}
+
+uint16_t LumpCursor::read_u16(void)
+{
+    _check(2);
+    uint16_t out = _data[_pos] | (_data[_pos + 1] << 8);
+    _pos += 2;
+    return out;
+}
+
+int16_t LumpCursor::read_i16(void)
+{
+    return (int16_t)read_u16();
+}
+
+uint32_t LumpCursor::read_u32(void)
+{
+    _check(4);
+    uint32_t out =\
+        (uint32_t)_data[_pos]
+        | ((uint32_t)_data[_pos + 1] << 8)
+        | ((uint32_t)_data[_pos + 2] << 16)
+        | ((uint32_t)_data[_pos + 3] << 24);
+    _pos += 4;
+    return out;
+}
+
+int32_t LumpCursor::read_i32(void)
+{
+    return (int32_t)read_u32();
+}
+
+void LumpCursor::read_bytes(void *out, size_t count)
+{
+    memcpy(out, take(count), count);
+}
+
+uint8_t const *LumpCursor::take(size_t count)
+{
+    _check(count);
+    auto out = _data + _pos;
+    _pos += count;
+    return out;
+}
+
+LumpCursor LumpCursor::subspan(size_t offset, size_t count) const
+{
+    if (offset > _size || count > _size - offset)
+    {
+        throw std::out_of_range{
+            "LumpCursor(\""
+            + std::string{_name}
+            + "\")::subspan -- "
+            + std::to_string(offset)
+            + "+"
+            + std::to_string(count)
+            + "/"
+            + std::to_string(_size)};
+    }
+    return LumpCursor{_data + offset, count, _name};
+}
+
+
+
+void DirEntry::_materialize(void)
+{
+    if (!data)
+    {
+        data = WADFile::view(file, filepos, size);
+    }
+    if (!touched)
+    {
+        WADFile::touch(*file, filepos, size);
+        touched = true;
+    }
+}
+
 void DirEntry::read(void *ptr, size_t byte_count)
 {
-    if (idx >= size)
+    _materialize();
+    if (idx < 0 || (size_t)idx > size || byte_count > size - (size_t)idx)
     {
         throw std::out_of_range{
             "DirEntry(\""
             + std::string{name}
             + "\")::read -- "
             + std::to_string(idx)
+            + "+"
+            + std::to_string(byte_count)
             + "/"
             + std::to_string(size)};
     }
@@ -32,6 +165,7 @@ void DirEntry::seek(ssize_t offset, int whence)
     {
     case SEEK_SET:
         idx = offset;
+        touched = false;
         break;
     case SEEK_CUR:
         idx += offset;
@@ -45,6 +179,110 @@ void DirEntry::seek(ssize_t offset, int whence)
     }
 }
 
+uint8_t const *DirEntry::bytes(void)
+{
+    _materialize();
+    return data.get();
+}
+
+LumpCursor DirEntry::cursor(void)
+{
+    return LumpCursor{bytes(), size, name};
+}
+
+
+
+uint64_t lumpkey(char const *name, size_t length)
+{
+    uint64_t key = 0;
+    for (size_t i = 0; i < length && i < 8 && name[i] != '\0'; ++i)
+    {
+        key |= (uint64_t)toupper((unsigned char)name[i]) << (8 * i);
+    }
+    return key;
+}
+
+std::string foldname(char const *name)
+{
+    std::string out{};
+    for (size_t i = 0; i < 8 && name[i] != '\0'; ++i)
+    {
+        out.push_back(toupper((unsigned char)name[i]));
+    }
+    return out;
+}
+
+bool ismapmarker(char const *name)
+{
+    size_t const length = strnlen(name, 8);
+    return (   (   length == 4
+                && name[0] == 'E'
+                && name[2] == 'M'
+                && isdigit(name[1])
+                && isdigit(name[3]))
+            || (   length == 5
+                && strncmp("MAP", name, 3) == 0
+                && isdigit(name[3])
+                && isdigit(name[4])));
+}
+
+
+void classifynamespaces(std::vector<DirEntry> &lumps)
+{
+    struct Markers
+    {
+        uint64_t start, end;
+        LumpNamespace ns;
+    };
+    static Markers const markers[] = {
+        {lumpkey("F_START"), lumpkey("F_END"), NS_FLATS},
+        {lumpkey("FF_START"), lumpkey("FF_END"), NS_FLATS},
+        {lumpkey("S_START"), lumpkey("S_END"), NS_SPRITES},
+        {lumpkey("SS_START"), lumpkey("SS_END"), NS_SPRITES},
+        {lumpkey("P_START"), lumpkey("P_END"), NS_PATCHES},
+        {lumpkey("PP_START"), lumpkey("PP_END"), NS_PATCHES},
+        {lumpkey("C_START"), lumpkey("C_END"), NS_COLORMAPS},
+    };
+
+    LumpNamespace current = NS_GLOBAL;
+    for (auto &lump : lumps)
+    {
+        auto const key = lumpkey(lump.name);
+
+        bool marker = false;
+        for (auto &m : markers)
+        {
+            if (key == m.start)
+            {
+                current = m.ns;
+                marker = true;
+            }
+            /* PWADs often close FF_START with F_END, so any end
+             * marker closes the namespace */
+            else if (key == m.end)
+            {
+                current = NS_GLOBAL;
+                marker = true;
+            }
+        }
+
+        /* F1_START, P2_END, etc. */
+        if (!marker && current != NS_GLOBAL && lump.size == 0)
+        {
+            size_t const length = strnlen(lump.name, 8);
+            auto endswith = [&lump, length](char const *suffix)
+            {
+                size_t const n = strlen(suffix);
+                return (   length > n
+                        && strcmp(lump.name + length - n, suffix) == 0);
+            };
+            marker = endswith("_START") || endswith("_END");
+        }
+
+        lump.ns = marker? NS_GLOBAL : current;
+    }
+}
+
 
 
 std::vector<DirEntry> WAD::findall(
@@ -52,9 +290,34 @@ std::vector<DirEntry> WAD::findall(
     size_t start) const
 {
     std::vector<DirEntry> out{};
-    for (size_t i = start; i < directory.size(); ++i)
+
+    /* names shorter than the prefix key have to be searched for
+     * the slow way */
+    if (name.size() < 4)
     {
-        if (strncasecmp(
+        for (size_t i = start; i < directory.size(); ++i)
+        {
+            if (strncasecmp(
+                    name.c_str(),
+                    directory[i].name,
+                    name.size()) == 0)
+            {
+                out.push_back(directory[i]);
+            }
+        }
+        return out;
+    }
+
+    _checkindex();
+    auto it = _prefixes.find(lumpkey(name.c_str(), 4));
+    if (it == _prefixes.end())
+    {
+        return out;
+    }
+    for (auto i : it->second)
+    {
+        if (   i >= start
+            && strncasecmp(
                 name.c_str(),
                 directory[i].name,
                 name.size()) == 0)
@@ -65,21 +328,305 @@ std::vector<DirEntry> WAD::findall(
     return out;
 }
 
-size_t WAD::lumpidx(std::string name, size_t start) const
+size_t WAD::lumpidx(std::string name, size_t start, size_t end) const
 {
-    for (size_t i = start; i < directory.size(); ++i)
+    auto indices = _lookup(name);
+    if (indices != nullptr)
     {
-        if (strncasecmp(name.c_str(), directory[i].name, 8) == 0)
+        auto it = std::lower_bound(
+            indices->begin(),
+            indices->end(),
+            start);
+        if (it != indices->end() && *it < end)
         {
-            return i;
+            return *it;
         }
     }
     throw std::out_of_range{
         "Couldn't find a lump named '" + name + "'"};
 }
 
-DirEntry &WAD::findlump(std::string name, size_t start)
+size_t WAD::lastidx(std::string name) const
 {
-    return directory[lumpidx(name, start)];
+    auto indices = _lookup(name);
+    if (indices == nullptr)
+    {
+        throw std::out_of_range{
+            "Couldn't find a lump named '" + name + "'"};
+    }
+    return indices->back();
+}
+
+bool WAD::haslump(std::string name) const
+{
+    auto indices = _lookup(name);
+    return indices != nullptr && !indices->empty();
+}
+
+DirEntry &WAD::findlump(std::string name, size_t start, size_t end)
+{
+    return directory[lumpidx(name, start, end)];
+}
+
+std::pair<size_t, size_t> WAD::nsrange(
+    std::string start,
+    std::string end) const
+{
+    auto first = lumpidx(start);
+    return {first + 1, lumpidx(end, first)};
+}
+
+std::pair<size_t, size_t> WAD::maprange(std::string map) const
+{
+    auto marker = lumpidx(map);
+    return {
+        marker + 1,
+        std::min(marker + 1 + MAP_LUMP_COUNT, directory.size())};
+}
+
+void WAD::append(DirEntry entry)
+{
+    directory.push_back(std::move(entry));
+    reindex(directory.size() - 1);
+}
+
+WAD::MergeStats WAD::merge(std::vector<DirEntry> lumps)
+{
+    static uint64_t const maplumps[] = {
+        lumpkey("THINGS"),
+        lumpkey("LINEDEFS"),
+        lumpkey("SIDEDEFS"),
+        lumpkey("VERTEXES"),
+        lumpkey("SEGS"),
+        lumpkey("SSECTORS"),
+        lumpkey("NODES"),
+        lumpkey("SECTORS"),
+        lumpkey("REJECT"),
+        lumpkey("BLOCKMAP"),
+    };
+
+    _checkindex();
+    directory.reserve(directory.size() + lumps.size());
+
+    MergeStats stats{0, 0};
+    size_t level = 0;
+
+    for (auto &entry : lumps)
+    {
+        auto const key = lumpkey(entry.name);
+        auto const it = _index.find(key);
+        auto const indices = (it == _index.end()? nullptr : &it->second);
+
+        /* if this lump is a level marker,
+         * set the directory search offset to here */
+        if (ismapmarker(entry.name))
+        {
+            if (indices != nullptr)
+            {
+                level = indices->front();
+            }
+            else
+            {
+                level = directory.size();
+                append(std::move(entry));
+                stats.added++;
+            }
+            continue;
+        }
+
+        size_t idx = SIZE_MAX;
+        if (indices != nullptr)
+        {
+            /* if this lump is a level lump, it replaces the level's */
+            if (   std::find(std::begin(maplumps), std::end(maplumps), key)
+                != std::end(maplumps))
+            {
+                auto lump = std::lower_bound(
+                    indices->begin(),
+                    indices->end(),
+                    level + 1);
+                if (   lump != indices->end()
+                    && *lump < level + 1 + MAP_LUMP_COUNT)
+                {
+                    idx = *lump;
+                }
+            }
+            else if (entry.ns != NS_GLOBAL)
+            {
+                for (auto i = indices->rbegin(); i != indices->rend(); ++i)
+                {
+                    if (directory[*i].ns == entry.ns)
+                    {
+                        idx = *i;
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                /* eg. a flat replaced by a PWAD without markers
+                 * is still a flat */
+                idx = indices->back();
+                entry.ns = directory[idx].ns;
+            }
+        }
+
+        /* the name is the same, so the index is still good */
+        if (idx != SIZE_MAX)
+        {
+            directory[idx] = std::move(entry);
+            stats.replaced++;
+        }
+        else
+        {
+            append(std::move(entry));
+            stats.added++;
+        }
+    }
+    return stats;
+}
+
+void WAD::reindex(size_t from)
+{
+    if (from == 0)
+    {
+        _index.clear();
+        _prefixes.clear();
+        for (auto &lumps : _namespaces)
+        {
+            lumps.clear();
+        }
+    }
+    else if (from != _indexed)
+    {
+        throw std::logic_error{
+            "WAD::reindex -- can't index from "
+            + std::to_string(from)
+            + ", only "
+            + std::to_string(_indexed)
+            + " lumps are indexed"};
+    }
+
+    for (size_t i = from; i < directory.size(); ++i)
+    {
+        _index[lumpkey(directory[i].name)].push_back(i);
+        _prefixes[lumpkey(directory[i].name, 4)].push_back(i);
+        if (directory[i].ns != NS_GLOBAL)
+        {
+            _namespaces[directory[i].ns].push_back(i);
+        }
+    }
+    _indexed = directory.size();
+}
+
+std::vector<size_t> const &WAD::nslumps(LumpNamespace ns) const
+{
+    _checkindex();
+    return _namespaces.at(ns);
 }
 
+void WAD::_checkindex(void) const
+{
+    if (_indexed != directory.size())
+    {
+        throw std::logic_error{
+            "WAD index is stale ("
+            + std::to_string(_indexed)
+            + "/"
+            + std::to_string(directory.size())
+            + " lumps indexed)"};
+    }
+}
+
+std::vector<size_t> const *WAD::_lookup(std::string const &name) const
+{
+    _checkindex();
+    auto it = _index.find(lumpkey(name.c_str()));
+    return it == _index.end()? nullptr : &it->second;
+}
+
+
+
+void PostPicture::rasterize_column(
+    size_t x,
+    IndexedPixel *out,
+    size_t stride) const
+{
+    for (size_t i = columns[x]; i < columns[x + 1]; ++i)
+    {
+        auto &post = posts[i];
+        auto src = &indices[post.offset];
+        auto dst = out + (post.row * stride);
+        for (size_t y = 0; y < post.length; ++y, dst += stride)
+        {
+            *dst = IndexedPixel{src[y], 0xFF, {0, 0}};
+        }
+    }
+}
+
+Picture PostPicture::rasterize(void) const
+{
+    Picture pic{};
+    pic.width = width;
+    pic.height = height;
+    pic.left = left;
+    pic.top = top;
+    pic.pixels = std::vector<IndexedPixel>(
+        width * height,
+        IndexedPixel{0, 0, {0, 0}});
+
+    for (size_t x = 0; x < width; ++x)
+    {
+        rasterize_column(x, &pic.pixels[x], width);
+    }
+    return pic;
+}
+
+
+
+Vertex const &Level::start(Linedef const &ld) const
+{
+    return vertices[ld.start];
+}
+
+Vertex const &Level::end(Linedef const &ld) const
+{
+    return vertices[ld.end];
+}
+
+Vertex const &Level::start(Seg const &seg) const
+{
+    return vertices[seg.start];
+}
+
+Vertex const &Level::end(Seg const &seg) const
+{
+    return vertices[seg.end];
+}
+
+Sidedef const *Level::right(Linedef const &ld) const
+{
+    return ld.right == NO_SIDEDEF? nullptr : &sidedefs[ld.right];
+}
+
+Sidedef const *Level::left(Linedef const &ld) const
+{
+    return ld.left == NO_SIDEDEF? nullptr : &sidedefs[ld.left];
+}
+
+Sidedef const *Level::front(Seg const &seg) const
+{
+    auto &ld = linedefs[seg.linedef];
+    return seg.direction? left(ld) : right(ld);
+}
+
+Sidedef const *Level::back(Seg const &seg) const
+{
+    auto &ld = linedefs[seg.linedef];
+    return seg.direction? right(ld) : left(ld);
+}
+
+Sector const &Level::sector(Sidedef const &sd) const
+{
+    return sectors[sd.sector];
+}
@@ -6,22 +6,43 @@
 #define _WAD_H
 
 #include <cstdint>
+#include <cstring>
 
 #include <array>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 
 
 /* pixel format: xxBBGGRR, xx=unused */
 typedef uint8_t Palette[256 * 3];
+static constexpr size_t PALETTE_COUNT = 14;
 
+/* maps palette indices to palette indices (one per light level,
+ * plus the invulnerability and all-black maps) */
+typedef uint8_t Colormap[256];
+static constexpr size_t COLORMAP_COUNT = 34;
 
 
+
+/* one pixel of a texture/picture/flat
+ * (laid out as GLTexture wants it: RGBA8UI, with the palette index
+ *  in R and alpha in G, so pixel buffers can be uploaded as-is) */
+struct IndexedPixel
+{
+    uint8_t index;
+    /* 0 = transparent, 0xFF = opaque */
+    uint8_t alpha;
+    uint8_t unused[2];
+};
+static_assert(sizeof(IndexedPixel) == 4, "IndexedPixel must be RGBA8");
+
 /* 64x64 indexed color */
-typedef std::array<uint8_t, 4096> Flat;
+typedef std::array<IndexedPixel, 4096> Flat;
 
 
 
@@ -48,8 +69,7 @@ struct TextureDefinition
 struct Texture
 {
     size_t width, height;
-    std::vector<uint8_t> data;
-    std::vector<bool> opaque;
+    std::vector<IndexedPixel> pixels;
 };
 
 
@@ -113,7 +133,7 @@ struct Sector
 {
     /* floor/ceiling heights */
     int16_t floor, ceiling;
-    std::string floor_flat, ceiling_flat;
+    char floor_flat[9], ceiling_flat[9];
     /* 00=black, FF=white
      * (this number is divided by 8 ie. 0 through 7 are the
      * same, 8 through 15 are the same, etc.) */
@@ -132,17 +152,20 @@ struct Sidedef
      * to move before pasting the texture */
     int16_t x, y;
     /* the upper, lower, and middle texture names */
-    std::string upper, lower, middle;
+    char upper[9], lower[9], middle[9];
     /* SECTOR index of the SECTOR this SIDEDEF helps surround */
-    Sector *sector;
+    uint16_t sector;
 };
 
 
 
+/* index used for a missing SIDEDEF */
+static constexpr uint16_t NO_SIDEDEF = 0xFFFF;
+
 struct Linedef
 {
     /* start/end VERTEX indices */
-    Vertex *start, *end;
+    uint16_t start, end;
     /* see LinedefFlags */
     uint16_t flags;
     /* see [4-3-2] */
@@ -151,8 +174,9 @@ struct Linedef
     uint16_t tag;
     /* left/right SIDEDEFs
      * (all LINEDEFs MUST have a right side)
-     * (see [4-3] for how to decide) */
-    Sidedef *right, *left;
+     * (see [4-3] for how to decide)
+     * (NO_SIDEDEF if there's no left side) */
+    uint16_t right, left;
 };
 
 /* see [4-3-1] */
@@ -183,7 +207,8 @@ enum LinedefFlags
 
 struct Seg
 {
-    Vertex *start, *end;
+    /* start/end VERTEX indices */
+    uint16_t start, end;
     /* 0000=east, 4000=north, 8000=west, C000=south
      * (Binary Angle Measurement) */
     uint16_t angle;
@@ -262,48 +287,315 @@ struct Picture
      */
     int16_t left, top;
 
-    std::vector<uint8_t> data;
-    std::vector<bool> opaque;
+    std::vector<IndexedPixel> pixels;
 };
 
+/* a picture kept as the column posts it's stored as on disk
+ * (only the opaque pixels are stored, so mostly transparent
+ *  pictures like sprites take a fraction of the memory) */
+struct PostPicture
+{
+    /* a vertical run of opaque pixels */
+    struct Post
+    {
+        uint16_t row, length;
+        /* where the post's pixels start in 'indices' */
+        uint32_t offset;
+    };
+
+    /* same as in Picture */
+    uint16_t width, height;
+    int16_t left, top;
+
+    /* the posts of column x are posts[columns[x]] up to (not
+     * including) posts[columns[x + 1]], top to bottom */
+    std::vector<uint32_t> columns;
+    std::vector<Post> posts;
+    /* palette indices of every post, back to back */
+    std::vector<uint8_t> indices;
+
+
+    /* draw column x into 'out', one pixel every 'stride' pixels
+     * (transparent pixels are left alone) */
+    void rasterize_column(
+        size_t x,
+        IndexedPixel *out,
+        size_t stride) const;
+
+    /* expand into a Picture */
+    Picture rasterize(void) const;
+};
+
+
+
+/* bounds-checked little-endian reader over a lump's bytes
+ * (each read checks its whole range up front, so a truncated lump
+ *  throws std::out_of_range instead of reading past the end) */
+class LumpCursor
+{
+private:
+    uint8_t const *_data;
+    size_t _size, _pos;
+    char _name[9];
+
+    /* throw unless 'count' more bytes can be read */
+    void _check(size_t count) const;
+
+public:
+    size_t size(void) const { return _size; }
+    size_t tell(void) const { return _pos; }
+    size_t remaining(void) const { return _size - _pos; }
+
+    /* move to an absolute position / skip some bytes */
+    void seek(size_t pos);
+    void skip(size_t count);
+
+    uint8_t read_u8(void);
+    uint16_t read_u16(void);
+    int16_t read_i16(void);
+    uint32_t read_u32(void);
+    int32_t read_i32(void);
+
+    /* copy 'count' raw bytes */
+    void read_bytes(void *out, size_t count);
+
+    /* get a pointer to the next 'count' bytes, and skip them */
+    uint8_t const *take(size_t count);
+
+    /* read 'count' little-endian integers in one go */
+    template<typename T>
+    std::vector<T> read_array(size_t count)
+    {
+        static_assert(std::is_integral<T>::value, "integers only");
+        _check(count * sizeof(T));
+        std::vector<T> out(count);
+        memcpy(out.data(), _data + _pos, count * sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for (auto &x : out)
+        {
+            x = _byteswap(x);
+        }
+#endif
+        _pos += count * sizeof(T);
+        return out;
+    }
+
+    /* get a cursor over part of this one
+     * (offset is from the start, not the current position) */
+    LumpCursor subspan(size_t offset, size_t count) const;
+
+
+    LumpCursor(uint8_t const *data, size_t size, char const *name="");
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+private:
+    template<typename T>
+    static T _byteswap(T x)
+    {
+        T out = 0;
+        for (size_t i = 0; i < sizeof(T); ++i)
+        {
+            out = (out << 8) | ((x >> (8 * i)) & 0xFF);
+        }
+        return out;
+    }
+#endif
+};
 
+/* which namespace a lump is in, going by the markers around it
+ * (see classifynamespaces) */
+enum LumpNamespace : uint8_t
+{
+    NS_GLOBAL,
+    NS_FLATS,
+    NS_SPRITES,
+    NS_PATCHES,
+    NS_COLORMAPS,
+    NS_COUNT,
+};
 
+/* NOTE: lumps are lazy; only the directory is read when a WAD is
+ * opened, the lump's body is fetched from its WADFile on first use */
 struct DirEntry
 {
 private:
     ssize_t idx = 0;
+    /* set once this entry has reported a use to the lump cache
+     * (reset by seeking to the start) */
+    bool touched = false;
+    std::shared_ptr<uint8_t const[]> data;
+
+    /* fetch the body and mark the lump as recently used */
+    void _materialize(void);
 
 public:
     uint32_t size;
     char name[9];
-    std::shared_ptr<uint8_t[]> data;
+
+    /* where the lump lives */
+    std::shared_ptr<class WADFile> file;
+    uint32_t filepos;
+    /* which of WAD::sources the lump came from */
+    uint16_t source = 0;
+    /* markers themselves are always NS_GLOBAL */
+    LumpNamespace ns = NS_GLOBAL;
 
     void read(void *ptr, size_t byte_count);
     void seek(ssize_t offset, int whence);
+
+    /* get the lump's whole body */
+    uint8_t const *bytes(void);
+
+    /* get a cursor over the lump's whole body */
+    LumpCursor cursor(void);
+};
+
+/* pack a lump name into 8 bytes, case-folded to uppercase
+ * (names shorter than 8 characters are NUL padded, same as on disk) */
+uint64_t lumpkey(char const *name, size_t length=8);
+
+/* a lump or texture name case-folded to uppercase, and cut off at 8
+ * characters (what WAD::textures and WAD::texturedefs are keyed by) */
+std::string foldname(char const *name);
+
+/* true iff 'name' is a map marker (ExMy or MAPxx) */
+bool ismapmarker(char const *name);
+
+/* set the namespace of every lump in a single .WAD's directory
+ * (X_START/X_END and the PWAD XX_START/XX_END markers both work, and
+ *  nested markers like F1_START are skipped) */
+void classifynamespaces(std::vector<DirEntry> &lumps);
+
+/* one frame of a sprite, as seen from 8 rotations
+ * (rotation 0 faces the viewer, the rest go round it in 45 degree
+ *  steps. A frame which only has one view uses it for all 8) */
+struct SpriteFrame
+{
+    struct View
+    {
+        /* the sprite lump ("" if the WAD doesn't have this view) */
+        std::string lump;
+        /* what to set the billboard shader's flipx to
+         * (the world's x is negated, so the lump's own view of an
+         *  angled frame is flipped to come out the right way round,
+         *  and the mirrored view, eg. A8 in TROOA2A8, isn't. Frames
+         *  with only one view aren't flipped) */
+        bool flipx;
+    };
+
+    bool rotated;
+    std::array<View, 8> views;
 };
 
 class WAD
 {
 public:
+    /* number of lumps following a map marker which belong to the map
+     * (THINGS, LINEDEFS, ..., BLOCKMAP) */
+    static constexpr size_t MAP_LUMP_COUNT = 10;
+
     bool iwad;
     std::vector<DirEntry> directory;
 
+    /* names of the files the lumps came from, in load order
+     * (the IWAD first, see DirEntry::source) */
+    std::vector<std::string> sources;
+
     std::vector<size_t> pnames;
-    std::array<Palette, 14> palettes;
+    std::array<Palette, PALETTE_COUNT> palettes;
+    std::array<Colormap, COLORMAP_COUNT> colormaps;
+    /* both keyed by foldname, so SIDEDEFs can name them in any case */
     std::unordered_map<std::string, Texture> textures;
-    std::unordered_map<std::string, Flat> flats;
-    std::unordered_map<std::string, Picture> sprites;
+    /* textures which haven't been composited yet
+     * (see readwad's lazy mode) */
+    std::unordered_map<std::string, TextureDefinition> texturedefs;
+    /* lumps with identical contents share one decoded image */
+    std::unordered_map<std::string, std::shared_ptr<Flat const>> flats;
+    std::unordered_map<
+        std::string,
+        std::shared_ptr<PostPicture const>> sprites;
+    /* sprite prefix (eg. "TROO") -> its frames, by frame letter
+     * (see buildspriteframes) */
+    std::unordered_map<
+        std::string,
+        std::vector<SpriteFrame>> spriteframes;
+
+    /* decoded patches, shared by every texture which uses them */
+    std::shared_ptr<class PatchCache> patches;
 
     /* get all the lumps starting with the given characters */
     std::vector<DirEntry> findall(
         std::string name,
         size_t start=0) const;
 
-    /* get the lump's index in the WAD's directory */
-    size_t lumpidx(std::string name, size_t start=0) const;
+    /* get the index of the first lump with the given name
+     * in the range [start, end) of the WAD's directory */
+    size_t lumpidx(
+        std::string name,
+        size_t start=0,
+        size_t end=SIZE_MAX) const;
+
+    /* get the index of the last lump with the given name
+     * (ie. the one which overrides all the others) */
+    size_t lastidx(std::string name) const;
+
+    /* check for a lump without reading it
+     * (eg. a MAP01 marker means it's a Doom II IWAD) */
+    bool haslump(std::string name) const;
 
     /* get the lump itself */
-    DirEntry &findlump(std::string name, size_t start=0);
+    DirEntry &findlump(
+        std::string name,
+        size_t start=0,
+        size_t end=SIZE_MAX);
+
+    /* get the range of lumps between two namespace markers
+     * (eg. F_START/F_END, markers excluded) */
+    std::pair<size_t, size_t> nsrange(
+        std::string start,
+        std::string end) const;
+
+    /* get the range of lumps belonging to a map
+     * (eg. E1M1 or MAP01, marker excluded) */
+    std::pair<size_t, size_t> maprange(std::string map) const;
+
+    /* add a lump to the end of the directory */
+    void append(DirEntry entry);
+
+    struct MergeStats
+    {
+        size_t replaced, added;
+    };
+
+    /* merge a PWAD's lumps into the directory
+     * (map lumps replace the ones following the most recent map
+     *  marker, lumps in a namespace replace the last lump with the
+     *  same name in that namespace, other lumps replace the last lump
+     *  with the same name (and take its namespace), and anything that
+     *  doesn't replace a lump is appended) */
+    MergeStats merge(std::vector<DirEntry> lumps);
+
+    /* indices of every lump in a namespace, in directory order */
+    std::vector<size_t> const &nslumps(LumpNamespace ns) const;
+
+    /* rebuild the lump index from directory[from] onwards
+     * (must be called after modifying 'directory' directly) */
+    void reindex(size_t from=0);
+
+private:
+    /* lumpkey -> directory indices, in ascending order */
+    std::unordered_map<uint64_t, std::vector<size_t>> _index;
+    /* same, but keyed by the first 4 characters (see findall) */
+    std::unordered_map<uint64_t, std::vector<size_t>> _prefixes;
+    /* directory indices of each namespace's lumps */
+    std::array<std::vector<size_t>, NS_COUNT> _namespaces;
+    /* number of directory entries covered by the index */
+    size_t _indexed = 0;
+
+    /* throw if the index doesn't cover the whole directory */
+    void _checkindex(void) const;
+    /* get all the indices of the lumps with the given name */
+    std::vector<size_t> const *_lookup(std::string const &name) const;
 };
 
 
@@ -322,6 +614,27 @@ struct Level
     std::vector<Sector> sectors;
     Reject reject;
     BlockMap blockmap;
+
+
+    /* The records refer to each other by index into the vectors
+     * above, so a Level can be freely copied/moved. These look the
+     * indices up. */
+
+    Vertex const &start(Linedef const &ld) const;
+    Vertex const &end(Linedef const &ld) const;
+    Vertex const &start(Seg const &seg) const;
+    Vertex const &end(Seg const &seg) const;
+
+    /* nullptr if the LINEDEF has no such side */
+    Sidedef const *right(Linedef const &ld) const;
+    Sidedef const *left(Linedef const &ld) const;
+
+    /* the SIDEDEF the SEG is on, and the one on the other side of
+     * its LINEDEF (nullptr if one-sided) */
+    Sidedef const *front(Seg const &seg) const;
+    Sidedef const *back(Seg const &seg) const;
+
+    Sector const &sector(Sidedef const &sd) const;
 };
 
 
@@ -0,0 +1,230 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#include "wadfile.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <utility>
+
+
+
+/* default lump cache budget */
+static size_t const DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+struct ResidentLump
+{
+    WADFile const *file;
+    size_t offset, size;
+};
+
+/* lumps are told apart by size as well as where they start, since
+ * several can start at the same offset (eg. PWAD lumps which reuse the
+ * same data) */
+typedef std::tuple<WADFile const *, size_t, size_t> LumpKey;
+
+static LumpKey _key(ResidentLump const &lump)
+{
+    return LumpKey{lump.file, lump.offset, lump.size};
+}
+
+/* the lump cache is shared by every WADFile */
+static struct
+{
+    std::mutex lock;
+    size_t budget = DEFAULT_BUDGET;
+    size_t resident = 0;
+    /* most recently used lumps at the front */
+    std::list<ResidentLump> lru;
+    std::map<LumpKey, std::list<ResidentLump>::iterator> lookup;
+} lumpcache;
+
+/* drop a lump's pages from our mapping
+ * (the caller must hold lumpcache.lock) */
+static void _evict(ResidentLump const &lump)
+{
+    static size_t const pagesize = sysconf(_SC_PAGESIZE);
+
+    /* only drop the pages which are entirely inside the lump,
+     * since the neighbours might still be in use */
+    size_t start = (lump.offset + pagesize - 1) / pagesize * pagesize,
+           end = (lump.offset + lump.size) / pagesize * pagesize;
+    if (start < end)
+    {
+        /* (madvise doesn't write, it just wants a non-const pointer) */
+        madvise(
+            const_cast<uint8_t *>(lump.file->data()) + start,
+            end - start,
+            MADV_DONTNEED);
+    }
+    lumpcache.resident -= lump.size;
+}
+
+/* evict lumps until we're under budget
+ * (the caller must hold lumpcache.lock) */
+static void _shrink(void)
+{
+    while (   lumpcache.budget != 0
+           && lumpcache.resident > lumpcache.budget
+           && lumpcache.lru.size() > 1)
+    {
+        auto &lump = lumpcache.lru.back();
+        _evict(lump);
+        lumpcache.lookup.erase(_key(lump));
+        lumpcache.lru.pop_back();
+    }
+}
+
+
+
+WADFile::WADFile(FILE *f)
+:   _data{nullptr},
+    _size{0},
+    _mtime{0}
+{
+    struct stat st{};
+    if (fstat(fileno(f), &st) == -1)
+    {
+        throw std::system_error{
+            errno,
+            std::generic_category(),
+            "fstat"};
+    }
+    if (st.st_size < 12)
+    {
+        throw std::runtime_error{
+            "WADFile -- file too small ("
+            + std::to_string(st.st_size)
+            + " bytes)"};
+    }
+    _size = st.st_size;
+    _mtime = (st.st_mtim.tv_sec * (int64_t)1000000000) + st.st_mtim.tv_nsec;
+
+    /* the mapping is private, so nothing we do
+     * can ever write back to the file */
+    void *ptr = mmap(
+        nullptr,
+        _size,
+        PROT_READ,
+        MAP_PRIVATE,
+        fileno(f),
+        0);
+    if (ptr == MAP_FAILED)
+    {
+        throw std::system_error{
+            errno,
+            std::generic_category(),
+            "mmap"};
+    }
+    _data = static_cast<uint8_t *>(ptr);
+}
+
+WADFile::~WADFile()
+{
+    {
+        std::lock_guard<std::mutex> guard{lumpcache.lock};
+        for (auto it = lumpcache.lru.begin(); it != lumpcache.lru.end();)
+        {
+            if (it->file == this)
+            {
+                lumpcache.resident -= it->size;
+                lumpcache.lookup.erase(_key(*it));
+                it = lumpcache.lru.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+    munmap(_data, _size);
+}
+
+uint8_t const *WADFile::data(void) const
+{
+    return _data;
+}
+
+size_t WADFile::size(void) const
+{
+    return _size;
+}
+
+int64_t WADFile::mtime(void) const
+{
+    return _mtime;
+}
+
+std::shared_ptr<uint8_t const[]> WADFile::view(
+    std::shared_ptr<WADFile> const &file,
+    size_t offset,
+    size_t size)
+{
+    if (offset > file->size() || size > file->size() - offset)
+    {
+        throw std::out_of_range{
+            "WADFile::view -- "
+            + std::to_string(offset)
+            + "+"
+            + std::to_string(size)
+            + "/"
+            + std::to_string(file->size())};
+    }
+    /* aliasing constructor: points into the mapping,
+     * but keeps the whole WADFile alive */
+    return std::shared_ptr<uint8_t const[]>{file, file->data() + offset};
+}
+
+
+
+void WADFile::touch(WADFile const &file, size_t offset, size_t size)
+{
+    /* markers have nothing to keep resident */
+    if (size == 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard{lumpcache.lock};
+
+    ResidentLump const lump{&file, offset, size};
+    auto it = lumpcache.lookup.find(_key(lump));
+    if (it != lumpcache.lookup.end())
+    {
+        lumpcache.lru.splice(
+            lumpcache.lru.begin(),
+            lumpcache.lru,
+            it->second);
+        return;
+    }
+
+    lumpcache.lru.push_front(lump);
+    lumpcache.lookup[_key(lump)] = lumpcache.lru.begin();
+    lumpcache.resident += size;
+    _shrink();
+}
+
+void WADFile::budget(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard{lumpcache.lock};
+    lumpcache.budget = bytes;
+    _shrink();
+}
+
+size_t WADFile::resident(void)
+{
+    std::lock_guard<std::mutex> guard{lumpcache.lock};
+    return lumpcache.resident;
+}
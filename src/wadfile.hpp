@@ -0,0 +1,79 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+#ifndef _WADFILE_H
+#define _WADFILE_H
+
+#include <cstdint>
+#include <cstdio>
+
+#include <memory>
+
+
+
+/* a .WAD file mmap'd into memory
+ * (lumps are views into the mapping, so a WADFile
+ *  is kept alive for as long as any lump refers to it) */
+class WADFile
+{
+private:
+    uint8_t *_data;
+    size_t _size;
+    int64_t _mtime;
+
+
+    /* no copying allowed! */
+    WADFile &operator=(WADFile const &other) = delete;
+    WADFile(WADFile const &other) = delete;
+
+public:
+
+    /* start of the mapping
+     * (read only: writing through it would fault) */
+    uint8_t const *data(void) const;
+
+    /* size of the mapping in bytes */
+    size_t size(void) const;
+
+    /* when the file was last modified, in nanoseconds since the epoch
+     * (as it was when it was mapped) */
+    int64_t mtime(void) const;
+
+    /* get a view of 'size' bytes at 'offset' which shares
+     * ownership of the mapping */
+    static std::shared_ptr<uint8_t const[]> view(
+        std::shared_ptr<WADFile> const &file,
+        size_t offset,
+        size_t size);
+
+
+    /* Lump cache:
+     *  Every lump that gets read is recorded as resident. Once the
+     *  resident lumps of all WADFiles add up to more than the budget,
+     *  the least recently used ones have their pages unmapped from
+     *  this process with MADV_DONTNEED. That only bounds how much of
+     *  the WADs counts towards our resident set: the pages stay in the
+     *  kernel's page cache (which it frees as it likes), and touching
+     *  them again just faults them straight back in. Set from the
+     *  command line with -lumpcache. */
+
+    /* mark a lump as recently used
+     * (empty lumps, like markers, aren't recorded) */
+    static void touch(WADFile const &file, size_t offset, size_t size);
+
+    /* set the lump cache budget in bytes (0 = unlimited, the default
+     * is 64MiB) */
+    static void budget(size_t bytes);
+
+    /* number of bytes the lump cache thinks are resident */
+    static size_t resident(void);
+
+
+    /* NOTE: 'f' can be closed once the WADFile is constructed */
+    WADFile(FILE *f);
+    ~WADFile();
+};
+
+
+#endif
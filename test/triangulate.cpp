@@ -0,0 +1,148 @@
+/* Copyright (C) 2020 Trevor Last
+ * See LICENSE file for copyright and license details.
+ */
+
+/* checks triangulate() on a few small shapes: every triangle has to be
+ * counterclockwise, and together they have to cover the right area */
+
+#include "triangulate.hpp"
+
+#include <cstdio>
+
+#include <string>
+#include <vector>
+
+
+
+static int failures = 0;
+
+/* triangulate 'loops' and check the triangles add up to 'area'
+ * (an area of 0 means nothing should come back) */
+static void check(
+    std::string const &name,
+    std::vector<std::vector<Vertex>> const &loops,
+    int64_t area)
+{
+    std::vector<Vertex> points{};
+    for (auto &loop : loops)
+    {
+        points.insert(points.end(), loop.begin(), loop.end());
+    }
+
+    auto indices = triangulate(loops);
+    bool ok = (indices.size() % 3 == 0);
+
+    /* twice the area, so it stays whole */
+    int64_t total = 0;
+    for (size_t i = 0; ok && i < indices.size(); i += 3)
+    {
+        if (   indices[i + 0] >= points.size()
+            || indices[i + 1] >= points.size()
+            || indices[i + 2] >= points.size())
+        {
+            ok = false;
+            break;
+        }
+        auto &a = points[indices[i + 0]],
+             &b = points[indices[i + 1]],
+             &c = points[indices[i + 2]];
+        int64_t const twice =\
+            ((int64_t)(b.x - a.x) * (c.y - a.y))
+          - ((int64_t)(b.y - a.y) * (c.x - a.x));
+        if (twice <= 0)
+        {
+            ok = false;
+        }
+        total += twice;
+    }
+    if (total != area * 2)
+    {
+        ok = false;
+    }
+
+    printf(
+        "%s: %s (%lu triangles, area %g, wanted %ld)\n",
+        ok? "ok" : "FAILED",
+        name.c_str(),
+        indices.size() / 3,
+        total / 2.0,
+        area);
+    if (!ok)
+    {
+        failures++;
+    }
+}
+
+
+int main(void)
+{
+    std::vector<Vertex> const square{{0,0}, {64,0}, {64,64}, {0,64}};
+
+    check("square", {square}, 64*64);
+
+    check(
+        "clockwise square",
+        {{{0,0}, {0,64}, {64,64}, {64,0}}},
+        64*64);
+
+    check(
+        "square with a hole",
+        {square, {{16,16}, {48,16}, {48,48}, {16,48}}},
+        (64*64) - (32*32));
+
+    check(
+        "square with a hole in a hole",
+        {   square,
+            {{8,8}, {56,8}, {56,56}, {8,56}},
+            {{16,16}, {48,16}, {48,48}, {16,48}}},
+        (64*64) - (48*48) + (32*32));
+
+    check(
+        "two squares sharing a corner",
+        {square, {{64,64}, {128,64}, {128,128}, {64,128}}},
+        2*64*64);
+
+    check(
+        "one loop through the same point twice",
+        {{  {0,0}, {64,0}, {64,64},
+            {128,64}, {128,128}, {64,128}, {64,64},
+            {0,64}}},
+        2*64*64);
+
+    check(
+        "hole touching the outside at a corner",
+        {square, {{0,0}, {32,16}, {16,32}}},
+        (64*64) - ((32*32) - (16*16)) / 2);
+
+    check(
+        "square with collinear points",
+        {{  {0,0}, {16,0}, {32,0}, {64,0},
+            {64,32}, {64,64},
+            {32,64}, {0,64},
+            {0,48}, {0,16}}},
+        64*64);
+
+    check(
+        "repeated points",
+        {{{0,0}, {0,0}, {64,0}, {64,64}, {64,64}, {0,64}, {0,0}}},
+        64*64);
+
+    check(
+        "square with a spike",
+        {{{0,0}, {64,0}, {64,32}, {96,32}, {64,32}, {64,64}, {0,64}}},
+        64*64);
+
+    check("bow tie", {{{0,0}, {64,64}, {64,0}, {0,64}}}, 0);
+
+    check(
+        "overlapping squares",
+        {square, {{32,32}, {96,32}, {96,96}, {32,96}}},
+        0);
+
+    check(
+        "edges along each other",
+        {square, {{0,0}, {32,0}, {32,-32}}},
+        0);
+
+    return failures? 1 : 0;
+}